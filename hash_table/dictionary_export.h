@@ -0,0 +1,346 @@
+#ifndef DICTIONARY_EXPORT_H
+#define DICTIONARY_EXPORT_H
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+enum class ExportFormat {
+	Tsv,
+	Csv,
+	JsonLines
+};
+
+enum class ExportOrder {
+	None,
+	ByCount,
+	ByKey
+};
+
+// Writes a dictionary as one record per line. Records are formatted into a
+// reusable buffer that is handed to the stream or file descriptor in large
+// chunks, so the exporter can be kept and reused across dumps.
+template<class Dictionary>
+class DictionaryExporter {
+public:
+	explicit DictionaryExporter(ExportFormat format = ExportFormat::Tsv,
+		ExportOrder order = ExportOrder::None,
+		size_t bufferSize = 1 << 20);
+	DictionaryExporter(const DictionaryExporter& copy) = delete;
+	DictionaryExporter& operator=(const DictionaryExporter& copy) = delete;
+
+	bool write(Dictionary& dict, std::ostream& out);
+	bool write(Dictionary& dict, int fd);
+
+private:
+	using entry_type = typename std::iterator_traits<typename Dictionary::iterator>::value_type;
+
+	ExportFormat format;
+	ExportOrder order;
+	std::vector<char> buffer;
+	size_t used;
+
+	template<class Sink>
+	bool writeAll(Dictionary& dict, Sink sink);
+	template<class Sink>
+	bool append(const char* data, size_t count, Sink& sink);
+	template<class Sink>
+	bool flush(Sink& sink);
+
+	template<class Sink>
+	bool appendRecord(const entry_type& entry, Sink& sink);
+	template<class Sink>
+	bool appendNumber(unsigned long long value, Sink& sink);
+	template<class Sink>
+	bool appendKey(const std::string& key, Sink& sink);
+	template<class Sink, class K>
+	typename std::enable_if<std::is_integral<K>::value, bool>::type appendKey(K key, Sink& sink);
+	template<class Sink, class K>
+	typename std::enable_if<std::is_enum<K>::value, bool>::type appendKey(K key, Sink& sink);
+
+	static size_t utf8Length(const std::string& key, size_t pos);
+
+	static bool writeFd(int fd, const char* data, size_t count);
+};
+
+template<class Dictionary>
+inline DictionaryExporter<Dictionary>::DictionaryExporter(ExportFormat format, ExportOrder order, size_t bufferSize) :
+	format(format),
+	order(order),
+	buffer(std::max<size_t>(bufferSize, 64)),
+	used(0)
+{}
+
+template<class Dictionary>
+inline bool DictionaryExporter<Dictionary>::write(Dictionary& dict, std::ostream& out) {
+	return writeAll(dict, [&out](const char* data, size_t count) {
+		out.write(data, static_cast<std::streamsize>(count));
+		return static_cast<bool>(out);
+	});
+}
+
+template<class Dictionary>
+inline bool DictionaryExporter<Dictionary>::write(Dictionary& dict, int fd) {
+	return writeAll(dict, [fd](const char* data, size_t count) {
+		return writeFd(fd, data, count);
+	});
+}
+
+template<class Dictionary>
+template<class Sink>
+inline bool DictionaryExporter<Dictionary>::writeAll(Dictionary& dict, Sink sink) {
+	used = 0;
+	if (order == ExportOrder::None) {
+		for (auto iter = dict.begin(); iter.ptr_; ++iter) {
+			if (!appendRecord(*iter, sink)) {
+				return false;
+			}
+		}
+		return flush(sink);
+	}
+	std::vector<const entry_type*> entries;
+	entries.reserve(dict.size());
+	for (auto iter = dict.begin(); iter.ptr_; ++iter) {
+		entries.push_back(&*iter);
+	}
+	if (order == ExportOrder::ByCount) {
+		std::sort(entries.begin(), entries.end(), [](const entry_type* left, const entry_type* right) {
+			if (left->data.second != right->data.second) {
+				return left->data.second > right->data.second;
+			}
+			return left->data.first < right->data.first;
+		});
+	}
+	else {
+		std::sort(entries.begin(), entries.end(), [](const entry_type* left, const entry_type* right) {
+			return left->data.first < right->data.first;
+		});
+	}
+	for (const entry_type* entry : entries) {
+		if (!appendRecord(*entry, sink)) {
+			return false;
+		}
+	}
+	return flush(sink);
+}
+
+template<class Dictionary>
+template<class Sink>
+inline bool DictionaryExporter<Dictionary>::append(const char* data, size_t count, Sink& sink) {
+	if (used + count > buffer.size()) {
+		if (!flush(sink)) {
+			return false;
+		}
+		if (count > buffer.size()) {
+			return sink(data, count);
+		}
+	}
+	std::memcpy(buffer.data() + used, data, count);
+	used += count;
+	return true;
+}
+
+template<class Dictionary>
+template<class Sink>
+inline bool DictionaryExporter<Dictionary>::flush(Sink& sink) {
+	if (used == 0) {
+		return true;
+	}
+	size_t count = used;
+	used = 0;
+	return sink(buffer.data(), count);
+}
+
+template<class Dictionary>
+template<class Sink>
+inline bool DictionaryExporter<Dictionary>::appendRecord(const entry_type& entry, Sink& sink) {
+	switch (format) {
+	case ExportFormat::Tsv:
+		return appendKey(entry.data.first, sink) &&
+			append("\t", 1, sink) &&
+			appendNumber(entry.data.second, sink) &&
+			append("\n", 1, sink);
+	case ExportFormat::Csv:
+		return appendKey(entry.data.first, sink) &&
+			append(",", 1, sink) &&
+			appendNumber(entry.data.second, sink) &&
+			append("\n", 1, sink);
+	default:
+		return append("{\"key\":", 7, sink) &&
+			appendKey(entry.data.first, sink) &&
+			append(",\"count\":", 9, sink) &&
+			appendNumber(entry.data.second, sink) &&
+			append("}\n", 2, sink);
+	}
+}
+
+template<class Dictionary>
+template<class Sink>
+inline bool DictionaryExporter<Dictionary>::appendNumber(unsigned long long value, Sink& sink) {
+	char digits[20];
+	char* pos = digits + sizeof(digits);
+	do {
+		*--pos = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	return append(pos, static_cast<size_t>(digits + sizeof(digits) - pos), sink);
+}
+
+template<class Dictionary>
+template<class Sink>
+inline bool DictionaryExporter<Dictionary>::appendKey(const std::string& key, Sink& sink) {
+	static const char hex[] = "0123456789abcdef";
+	if (format == ExportFormat::Tsv) {
+		size_t start = 0;
+		for (size_t i = 0; i < key.size(); ++i) {
+			char c = key[i];
+			const char* escape = c == '\t' ? "\\t" : c == '\n' ? "\\n" : c == '\r' ? "\\r" : c == '\\' ? "\\\\" : nullptr;
+			if (escape) {
+				if (!append(key.data() + start, i - start, sink) || !append(escape, 2, sink)) {
+					return false;
+				}
+				start = i + 1;
+			}
+		}
+		return append(key.data() + start, key.size() - start, sink);
+	}
+	if (format == ExportFormat::Csv) {
+		if (key.find_first_of(",\"\r\n") == std::string::npos) {
+			return append(key.data(), key.size(), sink);
+		}
+		if (!append("\"", 1, sink)) {
+			return false;
+		}
+		size_t start = 0;
+		for (size_t i = 0; i < key.size(); ++i) {
+			if (key[i] == '"') {
+				if (!append(key.data() + start, i + 1 - start, sink) || !append("\"", 1, sink)) {
+					return false;
+				}
+				start = i + 1;
+			}
+		}
+		return append(key.data() + start, key.size() - start, sink) && append("\"", 1, sink);
+	}
+	if (!append("\"", 1, sink)) {
+		return false;
+	}
+	size_t start = 0;
+	for (size_t i = 0; i < key.size(); ++i) {
+		unsigned char c = static_cast<unsigned char>(key[i]);
+		if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+			continue;
+		}
+		size_t valid = c >= 0x80 ? utf8Length(key, i) : 0;
+		if (valid != 0) {
+			i += valid - 1;
+			continue;
+		}
+		if (!append(key.data() + start, i - start, sink)) {
+			return false;
+		}
+		char escape[6] = { '\\', static_cast<char>(c), 0, 0, 0, 0 };
+		size_t length = 2;
+		if (c < 0x20 || c >= 0x80) {
+			escape[1] = 'u';
+			escape[2] = '0';
+			escape[3] = '0';
+			escape[4] = hex[c >> 4];
+			escape[5] = hex[c & 0xf];
+			length = 6;
+		}
+		if (!append(escape, length, sink)) {
+			return false;
+		}
+		start = i + 1;
+	}
+	return append(key.data() + start, key.size() - start, sink) && append("\"", 1, sink);
+}
+
+template<class Dictionary>
+template<class Sink, class K>
+inline typename std::enable_if<std::is_enum<K>::value, bool>::type DictionaryExporter<Dictionary>::appendKey(K key, Sink& sink) {
+	return appendKey(static_cast<typename std::underlying_type<K>::type>(key), sink);
+}
+
+template<class Dictionary>
+template<class Sink, class K>
+inline typename std::enable_if<std::is_integral<K>::value, bool>::type DictionaryExporter<Dictionary>::appendKey(K key, Sink& sink) {
+	if (key < K()) {
+		return append("-", 1, sink) &&
+			appendNumber(0ULL - static_cast<unsigned long long>(key), sink);
+	}
+	return appendNumber(static_cast<unsigned long long>(key), sink);
+}
+
+// Length of the well-formed UTF-8 sequence starting at pos, or 0 if there is
+// none, in which case JSON output escapes the byte as \u00XX.
+template<class Dictionary>
+inline size_t DictionaryExporter<Dictionary>::utf8Length(const std::string& key, size_t pos) {
+	auto byte = [&](size_t i) {
+		return pos + i < key.size() ? static_cast<unsigned char>(key[pos + i]) : 0;
+	};
+	unsigned char c = byte(0);
+	size_t length = 0;
+	unsigned char low = 0x80;
+	unsigned char high = 0xbf;
+	if (c >= 0xc2 && c <= 0xdf) {
+		length = 2;
+	}
+	else if (c >= 0xe0 && c <= 0xef) {
+		length = 3;
+		low = c == 0xe0 ? 0xa0 : 0x80;
+		high = c == 0xed ? 0x9f : 0xbf;
+	}
+	else if (c >= 0xf0 && c <= 0xf4) {
+		length = 4;
+		low = c == 0xf0 ? 0x90 : 0x80;
+		high = c == 0xf4 ? 0x8f : 0xbf;
+	}
+	else {
+		return 0;
+	}
+	if (byte(1) < low || byte(1) > high) {
+		return 0;
+	}
+	for (size_t i = 2; i < length; ++i) {
+		if (byte(i) < 0x80 || byte(i) > 0xbf) {
+			return 0;
+		}
+	}
+	return length;
+}
+
+template<class Dictionary>
+inline bool DictionaryExporter<Dictionary>::writeFd(int fd, const char* data, size_t count) {
+	while (count > 0) {
+		size_t chunk = std::min<size_t>(count, INT_MAX);
+#ifdef _WIN32
+		int written = _write(fd, data, static_cast<unsigned int>(chunk));
+#else
+		ssize_t written = ::write(fd, data, chunk);
+#endif
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return false;
+		}
+		data += written;
+		count -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+#endif
@@ -2,54 +2,123 @@
 #define DICTIONARY_MAP
 
 #include "hash_table.h"
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
 
-template<class Key>
+// ASCII case-folding hash and equality, so words can be counted
+// case-insensitively without lowering a copy of every token.
+struct CaseInsensitiveHash {
+	size_t operator()(const std::string& key) const noexcept {
+		unsigned long long hashCode = 14695981039346656037ULL;
+		for (char c : key) {
+			hashCode ^= static_cast<unsigned char>(foldCase(c));
+			hashCode *= 1099511628211ULL;
+		}
+		return static_cast<size_t>(hashCode);
+	}
+
+	size_t operator()(const std::string& key, size_t seed) const noexcept {
+		return sipHash(key.data(), key.size(), seed, foldCase);
+	}
+
+	static char foldCase(char c) noexcept {
+		return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+};
+
+struct CaseInsensitiveEqual {
+	bool operator()(const std::string& left, const std::string& right) const noexcept {
+		if (left.size() != right.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < left.size(); ++i) {
+			if (CaseInsensitiveHash::foldCase(left[i]) != CaseInsensitiveHash::foldCase(right[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+template<class Key,
+	class Hash = DefaultHash<Key>,
+	class KeyEqual = std::equal_to<Key>>
 class DictionaryMap {
 public:
 	using key_type = Key;
 	using mapped_type = size_t;
 	using value_type = std::pair<Key, mapped_type>;
-	using _Nodeptr = HashNode<value_type>;
-	using iterator = Iterator<_Nodeptr>;
-	using const_iterator = ConstIterator<_Nodeptr>;
+	using hasher = Hash;
+	using key_equal = KeyEqual;
+	using iterator = typename HashTable<Key, mapped_type, Hash, KeyEqual>::iterator;
+	using const_iterator = typename HashTable<Key, mapped_type, Hash, KeyEqual>::const_iterator;
+	using difference_value = std::pair<Key, long long>;
 
 	DictionaryMap(size_t count = 1);
-	DictionaryMap(const DictionaryMap<Key>& copy) = default;
-	DictionaryMap(DictionaryMap<Key>&& move) = default;
-	DictionaryMap<Key>& operator=(const DictionaryMap<Key>& copy) = default;
-	DictionaryMap<Key>& operator=(DictionaryMap<Key>&& move) noexcept = default;
+	DictionaryMap(const DictionaryMap& copy) = default;
+	DictionaryMap(DictionaryMap&& move) = default;
+	DictionaryMap& operator=(const DictionaryMap& copy) = default;
+	DictionaryMap& operator=(DictionaryMap&& move) noexcept = default;
 	~DictionaryMap() = default;
 
 	iterator begin() { return table.begin(); }
 	iterator end() { return table.end(); }
 
 	void insert(const key_type& key);
+	void insert(const key_type& key, mapped_type count);
 	bool erase(const key_type& key);
-	std::size_t find(const key_type& key);
+	std::size_t find(const key_type& key) const;
 	
-	size_t size() noexcept;
-	bool empty() noexcept;
+	size_t size() const noexcept;
+	bool empty() const noexcept;
 	void clear();
+
+	size_t bucket_count() const noexcept;
+	void reserve(size_t count);
+	void shrink_to_fit();
+	void compact();
+	MemoryUsage memory_usage() const;
+
+	void merge(const DictionaryMap& other);
+	void merge(DictionaryMap&& other);
+	void subtract(const DictionaryMap& other);
+	void intersect(const DictionaryMap& other);
+	std::vector<difference_value> diffTopK(const DictionaryMap& other, size_t k) const;
 	
+	std::vector<value_type> topK(size_t k) const;
 	void popularWords(value_type* arr);
 	void print(std::ostream& out);
 
 private:
-	HashTable<Key, size_t> table;
+	using table_type = HashTable<Key, size_t, Hash, KeyEqual>;
+	using range_type = typename table_type::BucketRange;
+	using entry_type = typename table_type::value_type;
+
+	table_type table;
+
+	// popularWords() reports this many entries, in ascending order of count.
+	static const size_t popular_count = 3;
 
-	void sortArr(value_type* arr);
+	void eraseEmpty();
+
+	static void pushTop(std::vector<const entry_type*>& heap, size_t k, const entry_type* value);
+	static void pushTopK(std::vector<difference_value>& heap, size_t k, const Key& key, long long diff);
 };
 
 
-template<class Key>
-inline DictionaryMap<Key>::DictionaryMap(size_t count) :
+template<class Key, class Hash, class KeyEqual>
+inline DictionaryMap<Key, Hash, KeyEqual>::DictionaryMap(size_t count) :
 	table{}
 {
 	table.rehash(count);
 }
 
-template<class Key>
-inline void DictionaryMap<Key>::insert(const key_type& key) {
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::insert(const key_type& key) {
 	auto elem = table.find(key);
 	if (elem.ptr_) {
 		++elem->data.second;
@@ -58,16 +127,29 @@ inline void DictionaryMap<Key>::insert(const key_type& key) {
 	table.insert(std::pair<Key, size_t>(key, 1));
 }
 
-template<class Key>
-inline bool DictionaryMap<Key>::erase(const key_type& key) {
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::insert(const key_type& key, mapped_type count) {
+	if (count == 0) {
+		return;
+	}
+	auto elem = table.find(key);
+	if (elem.ptr_) {
+		elem->data.second += count;
+		return;
+	}
+	table.insert(std::pair<Key, size_t>(key, count));
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline bool DictionaryMap<Key, Hash, KeyEqual>::erase(const key_type& key) {
 	if (table.erase(key)) {
 		return true;
 	}
 	return false;
 }
 
-template<class Key>
-inline std::size_t DictionaryMap<Key>::find(const key_type& key) {
+template<class Key, class Hash, class KeyEqual>
+inline std::size_t DictionaryMap<Key, Hash, KeyEqual>::find(const key_type& key) const {
 	auto node = table.find(key);
 	if (!node.ptr_) {
 		return 0;
@@ -75,73 +157,241 @@ inline std::size_t DictionaryMap<Key>::find(const key_type& key) {
 	return node->data.second;
 }
 
-template<class Key>
-inline size_t DictionaryMap<Key>::size() noexcept {
+template<class Key, class Hash, class KeyEqual>
+inline size_t DictionaryMap<Key, Hash, KeyEqual>::size() const noexcept {
 	return table.size();
 }
 
-template<class Key>
-inline bool DictionaryMap<Key>::empty() noexcept {
+template<class Key, class Hash, class KeyEqual>
+inline bool DictionaryMap<Key, Hash, KeyEqual>::empty() const noexcept {
 	return table.size() == 0;
 }
 
-template<class Key>
-inline void DictionaryMap<Key>::clear() {
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::clear() {
 	table.clear();
 }
 
-template<class Key>
-inline void DictionaryMap<Key>::popularWords(value_type* arr) {
-	if (table.size() == 0) {
-		return;
+template<class Key, class Hash, class KeyEqual>
+inline size_t DictionaryMap<Key, Hash, KeyEqual>::bucket_count() const noexcept {
+	return table.bucket_count();
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::reserve(size_t count) {
+	table.reserve(count);
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::shrink_to_fit() {
+	table.shrink_to_fit();
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::compact() {
+	table.shrink_to_fit();
+	table.compact();
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline MemoryUsage DictionaryMap<Key, Hash, KeyEqual>::memory_usage() const {
+	return table.memory_usage();
+}
+
+// Throws std::bad_alloc if a missing key cannot be added, by which point the
+// counts of shared keys have already been added.
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::merge(const DictionaryMap& other) {
+	size_t workers = other.table.default_workers();
+	std::vector<std::vector<const entry_type*>> missing(workers);
+	other.table.parallel_ranges([&](size_t worker, range_type range) {
+		other.table.bucket_for_each(range.first, range.last, [&](const entry_type& value) {
+			auto elem = table.find(value.first);
+			if (elem.ptr_) {
+				elem->data.second += value.second;
+			}
+			else {
+				missing[worker].push_back(&value);
+			}
+		});
+	}, workers);
+	size_t added = 0;
+	for (const auto& part : missing) {
+		added += part.size();
 	}
-	if (table.size() < 4) {
-		auto iter = table.begin();
-		for (size_t i = 0; i < table.size(); ++i) {
-			arr[i] = iter->data;
-			++iter;
+	table.reserve(table.size() + added);
+	for (const auto& part : missing) {
+		for (const auto* value : part) {
+			if (!table.insert(*value).first.ptr_) {
+				throw std::bad_alloc();
+			}
 		}
+	}
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::merge(DictionaryMap&& other) {
+	if (&other == this) {
+		merge(static_cast<const DictionaryMap&>(other));
 		return;
 	}
-	auto iter = table.begin();
-	for (size_t i = 0; i < 3; ++i) {
-		arr[i] = iter->data;
-		++iter;
+	other.table.for_each([&](const entry_type& value) {
+		auto elem = table.find(value.first);
+		if (elem.ptr_) {
+			elem->data.second += value.second;
+		}
+	});
+	table.merge(other.table);
+	other.clear();
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::subtract(const DictionaryMap& other) {
+	table.for_each([&](entry_type& value) {
+		auto elem = other.table.find(value.first);
+		if (elem.ptr_) {
+			value.second -= std::min(value.second, elem->data.second);
+		}
+	});
+	eraseEmpty();
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::intersect(const DictionaryMap& other) {
+	table.for_each([&](entry_type& value) {
+		auto elem = other.table.find(value.first);
+		value.second = elem.ptr_ ? std::min(value.second, elem->data.second) : 0;
+	});
+	eraseEmpty();
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline std::vector<typename DictionaryMap<Key, Hash, KeyEqual>::difference_value>
+DictionaryMap<Key, Hash, KeyEqual>::diffTopK(const DictionaryMap& other, size_t k) const {
+	std::vector<difference_value> result;
+	if (k == 0) {
+		return result;
 	}
-	sortArr(arr);
-	while (iter.ptr_) {
-		if (iter->data.second > arr[0].second) {
-			arr[0] = iter->data;
-			sortArr(arr);
+	size_t workers = std::max(table.default_workers(), other.table.default_workers());
+	std::vector<std::vector<difference_value>> heaps(workers);
+	table.parallel_ranges([&](size_t worker, range_type range) {
+		table.bucket_for_each(range.first, range.last, [&](const entry_type& value) {
+			auto elem = other.table.find(value.first);
+			long long before = elem.ptr_ ? static_cast<long long>(elem->data.second) : 0;
+			pushTopK(heaps[worker], k, value.first, static_cast<long long>(value.second) - before);
+		});
+	}, workers);
+	other.table.parallel_ranges([&](size_t worker, range_type range) {
+		other.table.bucket_for_each(range.first, range.last, [&](const entry_type& value) {
+			if (!table.find(value.first).ptr_) {
+				pushTopK(heaps[worker], k, value.first, -static_cast<long long>(value.second));
+			}
+		});
+	}, workers);
+	for (const auto& heap : heaps) {
+		for (const auto& value : heap) {
+			pushTopK(result, k, value.first, value.second);
 		}
-		++iter;
 	}
+	std::sort(result.begin(), result.end(), [](const difference_value& left, const difference_value& right) {
+		return std::abs(left.second) > std::abs(right.second);
+	});
+	return result;
 }
 
-template<class Key>
-inline void DictionaryMap<Key>::print(std::ostream& out) {
+template<class Key, class Hash, class KeyEqual>
+inline std::vector<typename DictionaryMap<Key, Hash, KeyEqual>::value_type> DictionaryMap<Key, Hash, KeyEqual>::topK(size_t k) const {
+	std::vector<value_type> result;
+	if (k == 0) {
+		return result;
+	}
+	size_t workers = table.default_workers();
+	std::vector<std::vector<const entry_type*>> heaps(workers);
+	table.parallel_ranges([&](size_t worker, range_type range) {
+		table.bucket_for_each(range.first, range.last, [&](const entry_type& value) {
+			pushTop(heaps[worker], k, &value);
+		});
+	}, workers);
+	std::vector<const entry_type*> top;
+	for (const auto& heap : heaps) {
+		for (const auto* value : heap) {
+			pushTop(top, k, value);
+		}
+	}
+	std::sort(top.begin(), top.end(), [](const entry_type* left, const entry_type* right) {
+		return left->second > right->second;
+	});
+	result.reserve(top.size());
+	for (const auto* value : top) {
+		result.emplace_back(value->first, value->second);
+	}
+	return result;
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::popularWords(value_type* arr) {
+	std::vector<value_type> top = topK(popular_count);
+	for (size_t i = 0; i < top.size(); ++i) {
+		arr[i] = top[top.size() - 1 - i];
+	}
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::print(std::ostream& out) {
 	auto iter = table.begin();
 	while (iter.ptr_) {
 		out << '(' << iter->data.first << " : " << iter->data.second << ") ";
 		++iter;
 	}
-	std::cout << '\n';
+	out << '\n';
 }
 
-template<class Key>
-inline void DictionaryMap<Key>::sortArr(value_type* arr) {
-	for (size_t i = 0; i < 2; i++) {
-		bool isSwap = false;
-		for (int j = 0; j < 2 - i; j++) {
-			if (arr[j].second > arr[j + 1].second) {
-				std::swap(arr[j], arr[j + 1]);
-				isSwap = true;
-			}
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::eraseEmpty() {
+	auto iter = table.begin();
+	while (iter.ptr_) {
+		if (iter->data.second == 0) {
+			iter = table.erase(iter);
 		}
-		if (!isSwap) {
-			break;
+		else {
+			++iter;
 		}
 	}
 }
 
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::pushTop(std::vector<const entry_type*>& heap, size_t k, const entry_type* value) {
+	auto greater = [](const entry_type* left, const entry_type* right) {
+		return left->second > right->second;
+	};
+	if (heap.size() < k) {
+		heap.push_back(value);
+		std::push_heap(heap.begin(), heap.end(), greater);
+	}
+	else if (value->second > heap.front()->second) {
+		std::pop_heap(heap.begin(), heap.end(), greater);
+		heap.back() = value;
+		std::push_heap(heap.begin(), heap.end(), greater);
+	}
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void DictionaryMap<Key, Hash, KeyEqual>::pushTopK(std::vector<difference_value>& heap, size_t k, const Key& key, long long diff) {
+	auto greater = [](const difference_value& left, const difference_value& right) {
+		return std::abs(left.second) > std::abs(right.second);
+	};
+	if (diff == 0) {
+		return;
+	}
+	if (heap.size() < k) {
+		heap.emplace_back(key, diff);
+		std::push_heap(heap.begin(), heap.end(), greater);
+	}
+	else if (std::abs(diff) > std::abs(heap.front().second)) {
+		std::pop_heap(heap.begin(), heap.end(), greater);
+		heap.back() = difference_value(key, diff);
+		std::push_heap(heap.begin(), heap.end(), greater);
+	}
+}
+
 #endif
\ No newline at end of file
@@ -3,16 +3,150 @@
 
 #include "forward_list.h"
 #include <iostream>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A 64-bit bit mixer. Integer keys default to std::hash, which is the
+// identity on common standard libraries and keeps dense ids one per bucket;
+// pass IntegralHash as Hash for key sets with regular strides. The table
+// also mixes with it after a reseed.
+template <class Key>
+struct IntegralHash {
+	size_t operator()(Key key) const noexcept {
+		unsigned long long x = static_cast<unsigned long long>(key);
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+		return static_cast<size_t>(x);
+	}
+};
+
+// SipHash-1-3 of size bytes, each passed through byte first, keyed by seed.
+// Colliding inputs cannot be built without knowing the seed.
+template <class Byte>
+inline size_t sipHash(const char* data, size_t size, size_t seed, Byte byte) noexcept {
+	auto rotl = [](unsigned long long x, int b) {
+		return (x << b) | (x >> (64 - b));
+	};
+	unsigned long long k0 = seed;
+	unsigned long long k1 = IntegralHash<unsigned long long>{} (k0);
+	unsigned long long v0 = k0 ^ 0x736f6d6570736575ULL;
+	unsigned long long v1 = k1 ^ 0x646f72616e646f6dULL;
+	unsigned long long v2 = k0 ^ 0x6c7967656e657261ULL;
+	unsigned long long v3 = k1 ^ 0x7465646279746573ULL;
+	auto round = [&]() {
+		v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+		v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+		v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+		v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+	};
+	unsigned long long word = 0;
+	for (size_t i = 0; i < size; ++i) {
+		word |= static_cast<unsigned long long>(static_cast<unsigned char>(byte(data[i]))) << (8 * (i % 8));
+		if (i % 8 == 7) {
+			v3 ^= word;
+			round();
+			v0 ^= word;
+			word = 0;
+		}
+	}
+	word |= static_cast<unsigned long long>(size) << 56;
+	v3 ^= word;
+	round();
+	v0 ^= word;
+	v2 ^= 0xff;
+	round();
+	round();
+	round();
+	return static_cast<size_t>(v0 ^ v1 ^ v2 ^ v3);
+}
+
+// std::hash for the common case. The seeded overload is only used once a
+// table has reseeded, since it is slower.
+struct StringHash {
+	size_t operator()(const std::string& key) const noexcept {
+		return std::hash<std::string>{} (key);
+	}
+
+	size_t operator()(const std::string& key, size_t seed) const noexcept {
+		return sipHash(key.data(), key.size(), seed, [](char c) {
+			return c;
+		});
+	}
+};
+
+// A hasher that can also be called as hash(key, seed) gets the table's seed
+// fed into the hash itself after a reseed, which also breaks up keys whose
+// unseeded hashes are equal.
+template <class Hash, class Key, class = void>
+struct IsSeededHash : std::false_type {};
+
+template <class Hash, class Key>
+struct IsSeededHash<Hash, Key, decltype(void(std::declval<const Hash&>()(std::declval<const Key&>(), size_t())))> : std::true_type {};
+
+template <class Key>
+using DefaultHash = typename std::conditional<std::is_same<Key, std::string>::value,
+	StringHash,
+	std::hash<Key>>::type;
 
 template <class T>
 struct HashNode {
+	HashNode(size_t hashCode, const T& value) :
+		cache(hashCode),
+		data(value)
+	{}
 	size_t cache;
 	T data;
 };
 
+// Each bucket keeps its run of nodes contiguous in the shared list. Besides
+// the predecessor needed for relinking, the bucket holds the first node of
+// the run, so lookups start at the run without touching the predecessor.
+struct HashBucket {
+	ListNodeBase* before;
+	ListNodeBase* first;
+};
+
+// Bytes held by a table, split by what owns them. Allocator overhead is not
+// included.
+struct MemoryUsage {
+	size_t buckets;
+	size_t nodes;
+	size_t keys;
+
+	size_t total() const noexcept {
+		return buckets + nodes + keys;
+	}
+};
+
+// Heap memory owned by a key beyond the node it is stored in.
+inline size_t keyHeapBytes(const std::string& key) noexcept {
+	const char* data = key.data();
+	const char* object = reinterpret_cast<const char*>(&key);
+	if (data >= object && data < object + sizeof(key)) {
+		return 0;
+	}
+	return key.capacity() + 1;
+}
+
+template<class K>
+inline size_t keyHeapBytes(const K&) noexcept {
+	return 0;
+}
+
 template <class Key,
 	class T,
-	class Hash = std::hash<Key>>
+	class Hash = DefaultHash<Key>,
+	class KeyEqual = std::equal_to<Key>>
 	class HashTable {
 public:
 	using value_type = std::pair<const Key, T>;
@@ -20,6 +154,7 @@ public:
 	using key_type = Key;
 	using mapped_type = T;
 	using hasher = Hash;
+	using key_equal = KeyEqual;
 	using size_type = size_t;
 	using difference_type = ptrdiff_t;
 	using reference = value_type&;
@@ -44,6 +179,10 @@ public:
 	const_iterator cend() const { return elems->cend(); }
 
 	void rehash(size_type n);
+	void reserve(size_type count);
+	void shrink_to_fit();
+	void compact();
+	MemoryUsage memory_usage() const;
 
 	std::pair<iterator, bool> insert(const value_type& value);
 
@@ -53,6 +192,32 @@ public:
 	iterator find(const key_type& key);
 	const_iterator find(const key_type& key) const;
 
+	void merge(HashTable& source);
+
+	template<class Function>
+	void bucket_for_each(size_type first, size_type last, Function f);
+	template<class Function>
+	void bucket_for_each(size_type first, size_type last, Function f) const;
+
+	// A slice of buckets [first, last). The slices returned by split() cover
+	// the table and can be walked by separate threads.
+	struct BucketRange {
+		size_type first;
+		size_type last;
+	};
+
+	std::vector<BucketRange> split(size_type parts) const;
+	size_type default_workers() const;
+
+	template<class Function>
+	void parallel_ranges(Function f, size_type workers = 0) const;
+	template<class Function>
+	void for_each(Function f, size_type workers = 0);
+	template<class Function>
+	void for_each(Function f, size_type workers = 0) const;
+	template<class Result, class Map, class Combine>
+	Result reduce(Result init, Map map, Combine combine, size_type workers = 0) const;
+
 	void swap(HashTable& ump) noexcept;
 	void clear();
 
@@ -65,254 +230,592 @@ public:
 
 private:
 	ForwardList<_Nodeptr>* elems;
-	Iterator<_Nodeptr>* arr;
+	HashBucket* arr;
 	size_type size_;
 	size_type bucket_count_;
 	float max_load_factor_;
+	size_type seed_;
+
+	// A bucket whose run holds this many other keys is taken as a sign of
+	// hostile input and triggers a reseed of the whole table. Keys with an
+	// equal hash only count if the hasher takes a seed, since otherwise a
+	// reseed cannot separate them.
+	static const size_type max_chain_length = 16;
+	// Whole-table walks only use several threads for tables this large.
+	static const size_type parallel_threshold = 1 << 15;
 
 	std::pair<iterator, bool> insert(_Nodeptr node);
+
+	static _Nodeptr& nodeData(ListNodeBase* p);
+	size_type hashKey(const key_type& key) const;
+	size_type hashKey(const key_type& key, std::true_type) const;
+	size_type hashKey(const key_type& key, std::false_type) const;
+	static size_type nodeHash(const _Nodeptr& node) noexcept;
+	void refreshHash(_Nodeptr& node) const;
+	void reseed();
+	void growIfNeeded();
+	void relinkBuckets();
+	static void freeChain(ListNodeBase* p);
+	ListNodeBase* findNode(const key_type& key) const;
+	void linkNode(ListNodeBase* p);
+	void unlinkNode(ListNodeBase* p);
 };
 
-template<class Key, class T, class Hash>
-inline HashTable<Key, T, Hash>::HashTable(size_type count) try :
+template<class Key, class T, class Hash, class KeyEqual>
+inline HashTable<Key, T, Hash, KeyEqual>::HashTable(size_type count) :
 	elems(new ForwardList<_Nodeptr>),
-	arr(new Iterator<_Nodeptr>[count]),
+	arr(nullptr),
 	size_(0),
-	bucket_count_(count),
-	max_load_factor_(1.0)
-{} 
-catch (const std::bad_alloc&) {
-	delete elems;
-	throw;
+	bucket_count_(count == 0 ? 1 : count),
+	max_load_factor_(1.0),
+	seed_(0)
+{
+	try {
+		arr = new HashBucket[bucket_count_]();
+	}
+	catch (const std::bad_alloc&) {
+		delete elems;
+		throw;
+	}
 }
 
-template<class Key, class T, class Hash>
-inline HashTable<Key, T, Hash>::HashTable(const HashTable& copy) :
+// The delegated constructor has finished, so if a node allocation throws the
+// destructor frees the nodes copied so far and the exception propagates.
+template<class Key, class T, class Hash, class KeyEqual>
+inline HashTable<Key, T, Hash, KeyEqual>::HashTable(const HashTable& copy) :
 	HashTable(copy.bucket_count_)
 {
-	try {
-		auto listNullIter = copy.elems->end();
-		for (auto i = copy.elems->begin(); i != listNullIter; ++i) {
-			size_type hashCode = i->cache;
-			this->insert(*i);
-		}
-	}
-	catch (...) {
-		this->clear();
+	seed_ = copy.seed_;
+	max_load_factor_ = copy.max_load_factor_;
+	ListNodeBase* tail = elems->before_begin().ptr_;
+	for (ListNodeBase* p = copy.elems->before_begin().ptr_->next; p; p = p->next) {
+		tail->next = new ListNode<_Nodeptr>(nodeData(p));
+		tail = tail->next;
+		++size_;
 	}
+	relinkBuckets();
 }
 
-template<class Key, class T, class Hash>
-inline HashTable<Key, T, Hash>::HashTable(HashTable&& move) :
+template<class Key, class T, class Hash, class KeyEqual>
+inline HashTable<Key, T, Hash, KeyEqual>::HashTable(HashTable&& move) :
 	HashTable()
 {
 	this->swap(move);
 }
 
-template<class Key, class T, class Hash>
-inline HashTable<Key, T, Hash>::~HashTable() {
+template<class Key, class T, class Hash, class KeyEqual>
+inline HashTable<Key, T, Hash, KeyEqual>::~HashTable() {
 	delete elems;
 	delete[] arr;
 }
 
-template<class Key, class T, class Hash>
-inline HashTable<Key, T, Hash>& HashTable<Key, T, Hash>::operator=(const HashTable& copy) {
+template<class Key, class T, class Hash, class KeyEqual>
+inline HashTable<Key, T, Hash, KeyEqual>& HashTable<Key, T, Hash, KeyEqual>::operator=(const HashTable& copy) {
 	HashTable temp(copy);
 	this->swap(temp);
 	return *this;
 }
 
-template<class Key, class T, class Hash>
-inline HashTable<Key, T, Hash>& HashTable<Key, T, Hash>::operator=(HashTable&& move) noexcept {
+template<class Key, class T, class Hash, class KeyEqual>
+inline HashTable<Key, T, Hash, KeyEqual>& HashTable<Key, T, Hash, KeyEqual>::operator=(HashTable&& move) noexcept {
 	this->swap(move);
 	return *this;
 }
 
-template<class Key, class T, class Hash>
-inline void HashTable<Key, T, Hash>::rehash(size_type n) {
-	if (n < bucket_count_) {
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::rehash(size_type n) {
+	size_type minimum = static_cast<size_type>(std::ceil(static_cast<double>(size_) / max_load_factor_));
+	if (n < minimum) {
+		n = minimum;
+	}
+	if (n == 0) {
+		n = 1;
+	}
+	if (n == bucket_count_) {
 		return;
 	}
-	HashTable tempHash(n);
-	auto listNullIter = elems->end();
-	for (auto i = elems->begin(); i != listNullIter; ++i) {
-		size_type hashCode = i->cache;
-		tempHash.insert(*i);
+	HashBucket* newArr = new HashBucket[n]();
+	ListNodeBase* head = elems->before_begin().ptr_;
+	ListNodeBase* p = head->next;
+	head->next = nullptr;
+	delete[] arr;
+	arr = newArr;
+	bucket_count_ = n;
+	while (p) {
+		ListNodeBase* next = p->next;
+		linkNode(p);
+		p = next;
+	}
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::reserve(size_type count) {
+	size_type needed = static_cast<size_type>(std::ceil(static_cast<double>(count) / max_load_factor_));
+	if (needed > bucket_count_) {
+		this->rehash(needed);
 	}
-	this->swap(tempHash);
 }
 
-template<class Key, class T, class Hash>
-inline std::pair<Iterator<HashNode<std::pair<const Key, T>>>, bool> HashTable<Key, T, Hash>::insert(const value_type& value) {
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::shrink_to_fit() {
+	this->rehash(0);
+}
+
+// Reallocates every node in list order, which keeps each bucket's run together,
+// and frees the old ones, so a table left sparse by erases gets fresh nodes
+// (and key buffers) allocated back to back. Invalidates all iterators. If an
+// allocation fails the table is left untouched.
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::compact() {
+	ListNodeBase* head = elems->before_begin().ptr_;
+	ListNodeBase fresh(nullptr);
+	ListNodeBase* tail = &fresh;
 	try {
-		size_type hashCode = hasher{} (value.first);
-		if (!arr[hashCode % bucket_count_].ptr_) {
-			iterator bktIter = elems->insert_after(elems->before_begin(), _Nodeptr{ hashCode, value });
-			arr[hashCode % bucket_count_] = elems->before_begin();
-			if (size_ > 0) {
-				auto buff = bktIter++;
-				size_t cacheMod = bktIter->cache % bucket_count_;
-				arr[cacheMod] = buff;
-			}
-		}
-		else {
-			elems->insert_after(arr[hashCode % bucket_count_], _Nodeptr{ hashCode, value });
+		for (ListNodeBase* p = head->next; p; p = p->next) {
+			tail->next = new ListNode<_Nodeptr>(nodeData(p));
+			tail = tail->next;
 		}
-		try {
-			++size_;
-			if (load_factor() > max_load_factor_) {
-				this->rehash(bucket_count_ * 2);
+	}
+	catch (...) {
+		freeChain(fresh.next);
+		throw;
+	}
+	freeChain(head->next);
+	head->next = fresh.next;
+	relinkBuckets();
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline MemoryUsage HashTable<Key, T, Hash, KeyEqual>::memory_usage() const {
+	MemoryUsage usage;
+	usage.buckets = bucket_count_ * sizeof(HashBucket);
+	usage.nodes = sizeof(*elems) + size_ * sizeof(ListNode<_Nodeptr>);
+	usage.keys = this->reduce(size_type(0), [](const_reference value) {
+		return keyHeapBytes(value.first);
+	}, [](size_type left, size_type right) {
+		return left + right;
+	});
+	return usage;
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline std::pair<typename HashTable<Key, T, Hash, KeyEqual>::iterator, bool> HashTable<Key, T, Hash, KeyEqual>::insert(const value_type& value) {
+	try {
+		size_type hashCode = hashKey(value.first);
+		size_type bkt = hashCode % bucket_count_;
+		size_type collisions = 0;
+		for (ListNodeBase* p = arr[bkt].first; p; p = p->next) {
+			const _Nodeptr& node = nodeData(p);
+			size_type nodeCode = nodeHash(node);
+			if (nodeCode % bucket_count_ != bkt) {
+				break;
+			}
+			if (nodeCode == hashCode && key_equal{} (node.data.first, value.first)) {
+				return std::pair<iterator, bool>(iterator(p), false);
+			}
+			if (nodeCode != hashCode || IsSeededHash<Hash, Key>::value) {
+				++collisions;
 			}
 		}
-		catch (...) {
-			--size_;
-			erase(++arr[hashCode % bucket_count_]);
-			return std::pair<iterator, bool>(elems->end(), false);
+		if (collisions >= max_chain_length &&
+			static_cast<float>(collisions) > 4 * max_load_factor_) {
+			this->reseed();
+			hashCode = hashKey(value.first);
 		}
-		return std::pair<iterator, bool>(arr[hashCode % bucket_count_], true);
+		return this->insert(_Nodeptr(hashCode, value));
 	}
 	catch (...) {
 		return std::pair<iterator, bool>(elems->end(), false);
 	}
 }
 
-template<class Key, class T, class Hash>
-inline Iterator<HashNode<std::pair<const Key, T>>> HashTable<Key, T, Hash>::erase(const_iterator position) {
+template<class Key, class T, class Hash, class KeyEqual>
+inline typename HashTable<Key, T, Hash, KeyEqual>::iterator HashTable<Key, T, Hash, KeyEqual>::erase(const_iterator position) {
 	if (!position.ptr_) {
 		return elems->end();
 	}
-	auto deleter = position++;
-	size_t hashCode = deleter->cache % bucket_count_;
-	auto checkPrev = arr[hashCode];
-	if (!position.ptr_ && checkPrev.ptr_->next == deleter.ptr_) {
-		delete deleter.ptr_;
-		checkPrev.ptr_->next = nullptr;
-		arr[hashCode] = elems->end();
-		--size_;
-		return checkPrev;
-	}
-	else if (position.ptr_ && (position->cache % bucket_count_ != hashCode)) {
-		if (checkPrev.ptr_->next == deleter.ptr_) {
-			arr[hashCode] = elems->end();
-			checkPrev.ptr_->next = deleter.ptr_->next;
-			arr[position->cache % bucket_count_] = checkPrev;
-		}
-		else {
-			arr[hashCode] = checkPrev;
-			checkPrev.ptr_->next = deleter.ptr_->next;
-		}
-	}
-	else {
-		while (checkPrev.ptr_->next != deleter.ptr_) {
-			++checkPrev;
-		}
-		checkPrev.ptr_->next = deleter.ptr_->next;
-	}
-	delete deleter.ptr_;
+	ListNodeBase* next = position.ptr_->next;
+	unlinkNode(position.ptr_);
+	delete static_cast<ListNode<_Nodeptr>*>(position.ptr_);
 	--size_;
-	return checkPrev;
+	return iterator(next);
 }
 
-template<class Key, class T, class Hash>
-inline size_t HashTable<Key, T, Hash>::erase(const key_type& k) {
+template<class Key, class T, class Hash, class KeyEqual>
+inline size_t HashTable<Key, T, Hash, KeyEqual>::erase(const key_type& k) {
 	auto buff = this->find(k);
-	if (!buff.ptr_ || this->erase(buff) == elems->end()) {
+	if (!buff.ptr_) {
 		return 0;
 	}
+	this->erase(buff);
 	return 1;
 }
 
-template<class Key, class T, class Hash>
-inline Iterator<HashNode<std::pair<const Key, T>>> HashTable<Key, T, Hash>::find(const key_type& key) {
-	size_type modHashCode = hasher{} (key) % bucket_count_;
-	iterator iter = arr[modHashCode];
-	if (iter.ptr_) {
-		++iter;
-		while (iter.ptr_ && (iter->cache % bucket_count_ == modHashCode)) {
-			if (iter->data.first == key) {
-				return iter;
+template<class Key, class T, class Hash, class KeyEqual>
+inline typename HashTable<Key, T, Hash, KeyEqual>::iterator HashTable<Key, T, Hash, KeyEqual>::find(const key_type& key) {
+	return iterator(findNode(key));
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline typename HashTable<Key, T, Hash, KeyEqual>::const_iterator HashTable<Key, T, Hash, KeyEqual>::find(const key_type& key) const {
+	return const_iterator(findNode(key));
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::merge(HashTable& source) {
+	if (&source == this) {
+		return;
+	}
+	ListNodeBase* p = source.elems->before_begin().ptr_->next;
+	while (p) {
+		ListNodeBase* next = p->next;
+		_Nodeptr& node = nodeData(p);
+		if (!findNode(node.data.first)) {
+			source.unlinkNode(p);
+			--source.size_;
+			if (seed_ != source.seed_) {
+				refreshHash(node);
+			}
+			linkNode(p);
+			++size_;
+			growIfNeeded();
+		}
+		p = next;
+	}
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+template<class Function>
+inline void HashTable<Key, T, Hash, KeyEqual>::bucket_for_each(size_type first, size_type last, Function f) {
+	for (size_type bkt = first; bkt < last; ++bkt) {
+		for (ListNodeBase* p = arr[bkt].first; p; p = p->next) {
+			_Nodeptr& node = nodeData(p);
+			if (nodeHash(node) % bucket_count_ != bkt) {
+				break;
 			}
-			++iter;
+			f(node.data);
 		}
 	}
-	return elems->end();
 }
 
-template<class Key, class T, class Hash>
-inline ConstIterator<HashNode<std::pair<const Key, T>>> HashTable<Key, T, Hash>::find(const key_type& key) const {
-	size_type modHashCode = hasher{} (key) % bucket_count_;
-	const_iterator iter = arr[modHashCode];
-	if (iter.ptr_) {
-		++iter;
-		while (iter.ptr_ && (iter->cache % bucket_count_ == modHashCode)) {
-			if (iter->data.first == key) {
-				return iter;
+template<class Key, class T, class Hash, class KeyEqual>
+template<class Function>
+inline void HashTable<Key, T, Hash, KeyEqual>::bucket_for_each(size_type first, size_type last, Function f) const {
+	for (size_type bkt = first; bkt < last; ++bkt) {
+		for (ListNodeBase* p = arr[bkt].first; p; p = p->next) {
+			const _Nodeptr& node = nodeData(p);
+			if (nodeHash(node) % bucket_count_ != bkt) {
+				break;
 			}
-			++iter;
+			f(static_cast<const_reference>(node.data));
+		}
+	}
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline std::vector<typename HashTable<Key, T, Hash, KeyEqual>::BucketRange> HashTable<Key, T, Hash, KeyEqual>::split(size_type parts) const {
+	if (parts == 0 || parts > bucket_count_) {
+		parts = bucket_count_;
+	}
+	std::vector<BucketRange> ranges;
+	ranges.reserve(parts);
+	for (size_type i = 0; i < parts; ++i) {
+		ranges.push_back(BucketRange{ bucket_count_ * i / parts, bucket_count_ * (i + 1) / parts });
+	}
+	return ranges;
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline size_t HashTable<Key, T, Hash, KeyEqual>::default_workers() const {
+	if (size_ < parallel_threshold) {
+		return 1;
+	}
+	size_type workers = std::thread::hardware_concurrency();
+	return workers == 0 ? 1 : workers;
+}
+
+// Calls f(worker, range) for every range of split(workers); range 0 runs on
+// the calling thread. The first exception thrown by a worker is rethrown
+// once all of them have finished.
+template<class Key, class T, class Hash, class KeyEqual>
+template<class Function>
+inline void HashTable<Key, T, Hash, KeyEqual>::parallel_ranges(Function f, size_type workers) const {
+	std::vector<BucketRange> ranges = split(workers == 0 ? default_workers() : workers);
+	std::vector<std::exception_ptr> errors(ranges.size());
+	std::vector<std::thread> threads;
+	auto run = [&](size_type worker) {
+		try {
+			f(worker, ranges[worker]);
+		}
+		catch (...) {
+			errors[worker] = std::current_exception();
+		}
+	};
+	try {
+		for (size_type worker = 1; worker < ranges.size(); ++worker) {
+			threads.emplace_back(run, worker);
 		}
 	}
-	return elems->cend();
+	catch (...) {
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		throw;
+	}
+	run(0);
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	for (auto& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+template<class Function>
+inline void HashTable<Key, T, Hash, KeyEqual>::for_each(Function f, size_type workers) {
+	HashTable* self = this;
+	parallel_ranges([self, &f](size_type, BucketRange range) {
+		self->bucket_for_each(range.first, range.last, f);
+	}, workers);
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+template<class Function>
+inline void HashTable<Key, T, Hash, KeyEqual>::for_each(Function f, size_type workers) const {
+	parallel_ranges([this, &f](size_type, BucketRange range) {
+		this->bucket_for_each(range.first, range.last, f);
+	}, workers);
 }
 
-template<class Key, class T, class Hash>
-inline void HashTable<Key, T, Hash>::clear() {
-	while (size_ != 0) {
-		erase(this->begin());
+// Each worker folds its ranges starting from init, so init has to be the
+// identity of combine; the partial results are then combined in range order.
+template<class Key, class T, class Hash, class KeyEqual>
+template<class Result, class Map, class Combine>
+inline Result HashTable<Key, T, Hash, KeyEqual>::reduce(Result init, Map map, Combine combine, size_type workers) const {
+	std::vector<BucketRange> ranges = split(workers == 0 ? default_workers() : workers);
+	struct Partial {
+		Result value;
+	};
+	std::vector<Partial> partial(ranges.size(), Partial{ init });
+	parallel_ranges([&](size_type worker, BucketRange range) {
+		Result& acc = partial[worker].value;
+		this->bucket_for_each(range.first, range.last, [&](const_reference value) {
+			acc = combine(acc, map(value));
+		});
+	}, ranges.size());
+	Result result = init;
+	for (auto& part : partial) {
+		result = combine(result, part.value);
 	}
+	return result;
 }
 
-template<class Key, class T, class Hash>
-inline void HashTable<Key, T, Hash>::swap(HashTable& ump) noexcept {
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::clear() {
+	elems->clear();
+	for (size_type i = 0; i < bucket_count_; ++i) {
+		arr[i] = HashBucket{};
+	}
+	size_ = 0;
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::swap(HashTable& ump) noexcept {
 	std::swap(elems, ump.elems);
 	std::swap(arr, ump.arr);
 	std::swap(size_, ump.size_);
 	std::swap(bucket_count_, ump.bucket_count_);
 	std::swap(max_load_factor_, ump.max_load_factor_);
+	std::swap(seed_, ump.seed_);
 }
 
-template<class Key, class T, class Hash>
-inline size_t HashTable<Key, T, Hash>::size() const noexcept {
+template<class Key, class T, class Hash, class KeyEqual>
+inline size_t HashTable<Key, T, Hash, KeyEqual>::size() const noexcept {
 	return size_;
 }
 
-template<class Key, class T, class Hash>
-inline size_t HashTable<Key, T, Hash>::bucket_count() const noexcept {
+template<class Key, class T, class Hash, class KeyEqual>
+inline size_t HashTable<Key, T, Hash, KeyEqual>::bucket_count() const noexcept {
 	return bucket_count_;
 }
 
-template<class Key, class T, class Hash>
-inline float HashTable<Key, T, Hash>::load_factor() const noexcept {
+template<class Key, class T, class Hash, class KeyEqual>
+inline float HashTable<Key, T, Hash, KeyEqual>::load_factor() const noexcept {
 	return static_cast<float>(size_) / static_cast<float>(bucket_count_);
 }
 
-template<class Key, class T, class Hash>
-inline float HashTable<Key, T, Hash>::max_load_factor() const noexcept {
+template<class Key, class T, class Hash, class KeyEqual>
+inline float HashTable<Key, T, Hash, KeyEqual>::max_load_factor() const noexcept {
 	return max_load_factor_;
 }
 
-template<class Key, class T, class Hash>
-inline void HashTable<Key, T, Hash>::max_load_factor(float ml) {
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::max_load_factor(float ml) {
 	max_load_factor_ = ml;
 }
 
-template<class Key, class T, class Hash>
-inline  std::pair<Iterator<HashNode<std::pair<const Key, T>>>, bool> HashTable<Key, T, Hash>::insert(_Nodeptr node) {
-	size_type hashCode = node.cache;
-	if (!arr[hashCode % bucket_count_].ptr_) {
-		arr[hashCode % bucket_count_] = elems->before_begin();
-		iterator bktIter = elems->insert_after(elems->before_begin(), _Nodeptr{ hashCode, node.data });
-		if (size_ > 0) {
-			auto value = bktIter++;
-			size_t cacheMod = bktIter->cache % bucket_count_;
-			arr[cacheMod] = value;
+template<class Key, class T, class Hash, class KeyEqual>
+inline  std::pair<typename HashTable<Key, T, Hash, KeyEqual>::iterator, bool> HashTable<Key, T, Hash, KeyEqual>::insert(_Nodeptr node) {
+	ListNode<_Nodeptr>* p = new ListNode<_Nodeptr>(node);
+	linkNode(p);
+	++size_;
+	growIfNeeded();
+	return std::pair<iterator, bool>(iterator(p), true);
+}
+
+// Rebuilds the bucket array from the list, whose bucket runs are already
+// contiguous, without hashing any key.
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::relinkBuckets() {
+	for (size_type i = 0; i < bucket_count_; ++i) {
+		arr[i] = HashBucket{};
+	}
+	ListNodeBase* prev = elems->before_begin().ptr_;
+	for (ListNodeBase* p = prev->next; p; p = p->next) {
+		size_type hashCode = nodeHash(nodeData(p));
+		HashBucket& bucket = arr[hashCode % bucket_count_];
+		if (!bucket.first) {
+			bucket = HashBucket{ prev, p };
 		}
+		prev = p;
+	}
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::freeChain(ListNodeBase* p) {
+	while (p) {
+		ListNode<_Nodeptr>* node = static_cast<ListNode<_Nodeptr>*>(p);
+		p = p->next;
+		delete node;
+	}
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::growIfNeeded() {
+	if (load_factor() > max_load_factor_) {
+		try {
+			this->rehash(bucket_count_ * 2);
+		}
+		catch (const std::bad_alloc&) {}
+	}
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline typename HashTable<Key, T, Hash, KeyEqual>::_Nodeptr& HashTable<Key, T, Hash, KeyEqual>::nodeData(ListNodeBase* p) {
+	return static_cast<ListNode<_Nodeptr>*>(p)->data;
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline size_t HashTable<Key, T, Hash, KeyEqual>::hashKey(const key_type& key) const {
+	return hashKey(key, IsSeededHash<Hash, Key>{});
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline size_t HashTable<Key, T, Hash, KeyEqual>::hashKey(const key_type& key, std::true_type) const {
+	if (seed_ == 0) {
+		return hasher{} (key);
+	}
+	return hasher{} (key, seed_);
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline size_t HashTable<Key, T, Hash, KeyEqual>::hashKey(const key_type& key, std::false_type) const {
+	size_type hashCode = hasher{} (key);
+	if (seed_ == 0) {
+		return hashCode;
+	}
+	return IntegralHash<size_type>{} (hashCode ^ seed_);
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline size_t HashTable<Key, T, Hash, KeyEqual>::nodeHash(const _Nodeptr& node) noexcept {
+	return node.cache;
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::refreshHash(_Nodeptr& node) const {
+	node.cache = hashKey(node.data.first);
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::reseed() {
+	size_type seed = static_cast<size_type>(std::random_device{}());
+	seed_ = IntegralHash<size_type>{} (seed ^ (seed_ + 0x9e3779b97f4a7c15ULL)) | 1;
+	ListNodeBase* head = elems->before_begin().ptr_;
+	ListNodeBase* p = head->next;
+	head->next = nullptr;
+	for (size_type i = 0; i < bucket_count_; ++i) {
+		arr[i] = HashBucket{};
+	}
+	while (p) {
+		ListNodeBase* next = p->next;
+		refreshHash(nodeData(p));
+		linkNode(p);
+		p = next;
+	}
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline ListNodeBase* HashTable<Key, T, Hash, KeyEqual>::findNode(const key_type& key) const {
+	size_type hashCode = hashKey(key);
+	size_type bkt = hashCode % bucket_count_;
+	for (ListNodeBase* p = arr[bkt].first; p; p = p->next) {
+		const _Nodeptr& node = nodeData(p);
+		size_type nodeCode = nodeHash(node);
+		if (nodeCode % bucket_count_ != bkt) {
+			break;
+		}
+		if (nodeCode == hashCode && key_equal{} (node.data.first, key)) {
+			return p;
+		}
+	}
+	return nullptr;
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::linkNode(ListNodeBase* p) {
+	HashBucket& bucket = arr[nodeHash(nodeData(p)) % bucket_count_];
+	if (!bucket.first) {
+		ListNodeBase* head = elems->before_begin().ptr_;
+		p->next = head->next;
+		head->next = p;
+		if (p->next) {
+			arr[nodeHash(nodeData(p->next)) % bucket_count_].before = p;
+		}
+		bucket.before = head;
 	}
 	else {
-		elems->insert_after(arr[hashCode % bucket_count_], _Nodeptr{ hashCode, node.data });
+		p->next = bucket.first;
+		bucket.before->next = p;
+	}
+	bucket.first = p;
+}
+
+template<class Key, class T, class Hash, class KeyEqual>
+inline void HashTable<Key, T, Hash, KeyEqual>::unlinkNode(ListNodeBase* p) {
+	size_type bkt = nodeHash(nodeData(p)) % bucket_count_;
+	HashBucket& bucket = arr[bkt];
+	ListNodeBase* prev = bucket.before;
+	while (prev->next != p) {
+		prev = prev->next;
+	}
+	ListNodeBase* next = p->next;
+	prev->next = next;
+	size_type nextBkt = next ? nodeHash(nodeData(next)) % bucket_count_ : bkt;
+	if (prev == bucket.before) {
+		if (next && nextBkt == bkt) {
+			bucket.first = next;
+			return;
+		}
+		bucket = HashBucket{};
+	}
+	if (next && nextBkt != bkt) {
+		arr[nextBkt].before = prev;
 	}
-	++size_;
-	return std::pair<iterator, bool>(arr[hashCode % bucket_count_], true);
 }
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,382 @@
+#ifndef INGEST_BENCHMARK_H
+#define INGEST_BENCHMARK_H
+
+#include "user_interface.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Draws ranks 0..vocabulary-1 with probability proportional to
+// 1 / (rank + 1)^exponent by binary search over the cumulative distribution.
+class ZipfGenerator {
+public:
+	ZipfGenerator(size_t vocabulary, double exponent, std::uint64_t seed) :
+		cdf(std::max<size_t>(vocabulary, 1)),
+		rng(seed),
+		uniform(0.0, 1.0)
+	{
+		double sum = 0;
+		for (size_t i = 0; i < cdf.size(); ++i) {
+			sum += 1.0 / std::pow(static_cast<double>(i + 1), exponent);
+			cdf[i] = sum;
+		}
+		for (auto& value : cdf) {
+			value /= sum;
+		}
+	}
+
+	size_t next() {
+		double u = uniform(rng);
+		size_t rank = static_cast<size_t>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+		return std::min(rank, cdf.size() - 1);
+	}
+
+private:
+	std::vector<double> cdf;
+	std::mt19937_64 rng;
+	std::uniform_real_distribution<double> uniform;
+};
+
+// Log-linear histogram of nanosecond latencies: every power of two is split
+// into sub_buckets linear steps, so percentiles are within about 6%.
+class LatencyHistogram {
+public:
+	LatencyHistogram() :
+		counts(64 * sub_buckets, 0),
+		total(0),
+		maximum(0)
+	{}
+
+	void record(std::uint64_t nanos) {
+		++counts[index(nanos)];
+		++total;
+		maximum = std::max(maximum, nanos);
+	}
+
+	std::uint64_t percentile(double p) const {
+		if (total == 0) {
+			return 0;
+		}
+		std::uint64_t rank = static_cast<std::uint64_t>(std::ceil(p / 100.0 * static_cast<double>(total)));
+		rank = std::max<std::uint64_t>(rank, 1);
+		std::uint64_t seen = 0;
+		for (size_t i = 0; i < counts.size(); ++i) {
+			seen += counts[i];
+			if (seen >= rank) {
+				return std::min(upperBound(i), maximum);
+			}
+		}
+		return maximum;
+	}
+
+	std::uint64_t max() const noexcept {
+		return maximum;
+	}
+
+	std::uint64_t count() const noexcept {
+		return total;
+	}
+
+private:
+	static const size_t sub_buckets = 16;
+
+	std::vector<std::uint64_t> counts;
+	std::uint64_t total;
+	std::uint64_t maximum;
+
+	static size_t index(std::uint64_t nanos) {
+		if (nanos < sub_buckets) {
+			return static_cast<size_t>(nanos);
+		}
+		size_t exponent = 0;
+		while ((nanos >> exponent) >= 2 * sub_buckets) {
+			++exponent;
+		}
+		return (exponent + 1) * sub_buckets + static_cast<size_t>((nanos >> exponent) - sub_buckets);
+	}
+
+	static std::uint64_t upperBound(size_t i) {
+		if (i < sub_buckets) {
+			return i;
+		}
+		size_t exponent = i / sub_buckets - 1;
+		std::uint64_t base = static_cast<std::uint64_t>(sub_buckets + i % sub_buckets) << exponent;
+		return base + ((1ULL << exponent) - 1);
+	}
+};
+
+struct BenchmarkResult {
+	size_t tokens;
+	size_t vocabulary;
+	double exponent;
+	std::uint64_t p50;
+	std::uint64_t p99;
+	std::uint64_t p999;
+	std::uint64_t p99999;
+	std::uint64_t max;
+	std::uint64_t stalls;
+	double insertsPerSecond;
+	double tokensPerSecond;
+};
+
+// Replays a synthetic Zipfian corpus through DictionaryMap::insert, timing
+// every call with steady_clock, and through UserInterface::insertTextFromFile
+// for end-to-end throughput. Growth stalls are far rarer than one op in a
+// thousand, so besides percentiles every run counts the inserts slower than
+// stallNanos; that count, the maximum and both throughputs are the medians
+// over all runs. Results can be saved as a baseline and later runs compared
+// against it. The corpus file gets a fresh random name in the working
+// directory and is removed afterwards; run() throws std::runtime_error if it
+// cannot be written or read back.
+class IngestBenchmark {
+public:
+	struct Config {
+		size_t tokens = 2000000;
+		size_t vocabulary = 200000;
+		double exponent = 1.1;
+		std::uint64_t seed = 42;
+		size_t runs = 3;
+		std::uint64_t stallNanos = 100000;
+		double tolerance = 0.10;
+	};
+
+	explicit IngestBenchmark(const Config& config) :
+		config(config)
+	{}
+
+	BenchmarkResult run();
+
+	static bool saveBaseline(const std::string& path, const BenchmarkResult& result);
+	static bool loadBaseline(const std::string& path, BenchmarkResult& result);
+	static bool sameWorkload(const BenchmarkResult& baseline, const BenchmarkResult& current);
+	std::vector<std::string> compare(const BenchmarkResult& baseline, const BenchmarkResult& current) const;
+	static void report(std::ostream& out, const BenchmarkResult& result);
+
+private:
+	Config config;
+
+	std::vector<std::string> generateCorpus() const;
+	static std::string uniqueCorpusPath();
+
+	template<class T>
+	static T median(std::vector<T> values);
+};
+
+inline std::vector<std::string> IngestBenchmark::generateCorpus() const {
+	ZipfGenerator zipf(config.vocabulary, config.exponent, config.seed);
+	std::vector<std::string> corpus;
+	corpus.reserve(config.tokens);
+	for (size_t i = 0; i < config.tokens; ++i) {
+		corpus.push_back("w" + std::to_string(zipf.next()));
+	}
+	return corpus;
+}
+
+// Picks a name no existing file uses, so the benchmark never overwrites or
+// removes a file it did not create.
+inline std::string IngestBenchmark::uniqueCorpusPath() {
+	std::random_device device;
+	std::mt19937_64 rng((static_cast<std::uint64_t>(device()) << 32) ^ device() ^
+		static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+	for (int attempt = 0; attempt < 100; ++attempt) {
+		std::ostringstream name;
+		name << "ingest_corpus_" << std::hex << rng() << ".tmp";
+		if (!std::ifstream(name.str()).is_open()) {
+			return name.str();
+		}
+	}
+	throw std::runtime_error("cannot find an unused name for the benchmark corpus");
+}
+
+inline BenchmarkResult IngestBenchmark::run() {
+	using clock = std::chrono::steady_clock;
+	std::vector<std::string> corpus = generateCorpus();
+
+	std::string corpusPath = uniqueCorpusPath();
+	{
+		std::ofstream out(corpusPath);
+		for (size_t i = 0; i < corpus.size(); ++i) {
+			out << corpus[i] << ((i % 16 == 15) ? '\n' : ' ');
+		}
+		out.close();
+		if (out.fail()) {
+			std::remove(corpusPath.c_str());
+			throw std::runtime_error("cannot write benchmark corpus " + corpusPath);
+		}
+	}
+
+	LatencyHistogram histogram;
+	std::vector<std::uint64_t> maxima;
+	std::vector<std::uint64_t> stalls;
+	std::vector<double> rates;
+	std::vector<double> fileRates;
+	try {
+		for (size_t run = 0; run < std::max<size_t>(config.runs, 1); ++run) {
+			std::uint64_t maximum = 0;
+			std::uint64_t slow = 0;
+			DictionaryMap<std::string> dict;
+			clock::time_point start = clock::now();
+			for (const auto& token : corpus) {
+				clock::time_point before = clock::now();
+				dict.insert(token);
+				clock::time_point after = clock::now();
+				std::uint64_t nanos = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count());
+				histogram.record(nanos);
+				maximum = std::max(maximum, nanos);
+				if (nanos > config.stallNanos) {
+					++slow;
+				}
+			}
+			double seconds = std::chrono::duration<double>(clock::now() - start).count();
+			maxima.push_back(maximum);
+			stalls.push_back(slow);
+			rates.push_back(seconds > 0 ? static_cast<double>(corpus.size()) / seconds : 0);
+
+			UserInterface ui;
+			if (!ui.openFile(corpusPath)) {
+				throw std::runtime_error("cannot read benchmark corpus " + corpusPath);
+			}
+			clock::time_point fileStart = clock::now();
+			ui.insertTextFromFile();
+			double fileSeconds = std::chrono::duration<double>(clock::now() - fileStart).count();
+			fileRates.push_back(fileSeconds > 0 ? static_cast<double>(corpus.size()) / fileSeconds : 0);
+		}
+	}
+	catch (...) {
+		std::remove(corpusPath.c_str());
+		throw;
+	}
+	std::remove(corpusPath.c_str());
+
+	BenchmarkResult result;
+	result.tokens = config.tokens;
+	result.vocabulary = config.vocabulary;
+	result.exponent = config.exponent;
+	result.p50 = histogram.percentile(50);
+	result.p99 = histogram.percentile(99);
+	result.p999 = histogram.percentile(99.9);
+	result.p99999 = histogram.percentile(99.999);
+	result.max = median(maxima);
+	result.stalls = median(stalls);
+	result.insertsPerSecond = median(rates);
+	result.tokensPerSecond = median(fileRates);
+	return result;
+}
+
+inline bool IngestBenchmark::saveBaseline(const std::string& path, const BenchmarkResult& result) {
+	std::ofstream out(path);
+	if (!out.is_open()) {
+		return false;
+	}
+	out.precision(10);
+	out << "tokens " << result.tokens << '\n';
+	out << "vocabulary " << result.vocabulary << '\n';
+	out << "exponent " << result.exponent << '\n';
+	out << "p50_ns " << result.p50 << '\n';
+	out << "p99_ns " << result.p99 << '\n';
+	out << "p999_ns " << result.p999 << '\n';
+	out << "p99999_ns " << result.p99999 << '\n';
+	out << "max_ns " << result.max << '\n';
+	out << "stalls " << result.stalls << '\n';
+	out << "inserts_per_second " << result.insertsPerSecond << '\n';
+	out << "tokens_per_second " << result.tokensPerSecond << '\n';
+	return static_cast<bool>(out);
+}
+
+inline bool IngestBenchmark::loadBaseline(const std::string& path, BenchmarkResult& result) {
+	std::ifstream in(path);
+	if (!in.is_open()) {
+		return false;
+	}
+	std::map<std::string, double> values;
+	std::string name;
+	double value;
+	while (in >> name >> value) {
+		values[name] = value;
+	}
+	const char* required[] = { "tokens", "vocabulary", "exponent", "p50_ns", "p99_ns", "p999_ns",
+		"p99999_ns", "max_ns", "stalls", "inserts_per_second", "tokens_per_second" };
+	for (const char* key : required) {
+		if (!values.count(key)) {
+			return false;
+		}
+	}
+	result.tokens = static_cast<size_t>(values["tokens"]);
+	result.vocabulary = static_cast<size_t>(values["vocabulary"]);
+	result.exponent = values["exponent"];
+	result.p50 = static_cast<std::uint64_t>(values["p50_ns"]);
+	result.p99 = static_cast<std::uint64_t>(values["p99_ns"]);
+	result.p999 = static_cast<std::uint64_t>(values["p999_ns"]);
+	result.p99999 = static_cast<std::uint64_t>(values["p99999_ns"]);
+	result.max = static_cast<std::uint64_t>(values["max_ns"]);
+	result.stalls = static_cast<std::uint64_t>(values["stalls"]);
+	result.insertsPerSecond = values["inserts_per_second"];
+	result.tokensPerSecond = values["tokens_per_second"];
+	return true;
+}
+
+inline bool IngestBenchmark::sameWorkload(const BenchmarkResult& baseline, const BenchmarkResult& current) {
+	return baseline.tokens == current.tokens &&
+		baseline.vocabulary == current.vocabulary &&
+		std::fabs(baseline.exponent - current.exponent) < 1e-6;
+}
+
+// Percentiles up to p99.9 and the stall count regress when they grow by more
+// than the tolerance, throughput when it drops by more than the tolerance.
+// The stall count may also grow by one, so a baseline without stalls is not
+// failed by a single preemption. p99.999 and the maximum are only reported,
+// since they depend on a handful of ops and vary too much between runs.
+inline std::vector<std::string> IngestBenchmark::compare(const BenchmarkResult& baseline, const BenchmarkResult& current) const {
+	std::vector<std::string> regressions;
+	auto latency = [&](const char* name, std::uint64_t before, std::uint64_t now) {
+		if (static_cast<double>(now) > static_cast<double>(before) * (1.0 + config.tolerance)) {
+			regressions.push_back(std::string(name) + ": " + std::to_string(before) + " -> " + std::to_string(now) + " ns");
+		}
+	};
+	auto count = [&](const char* name, std::uint64_t before, std::uint64_t now) {
+		if (static_cast<double>(now) > static_cast<double>(before) * (1.0 + config.tolerance) + 1) {
+			regressions.push_back(std::string(name) + ": " + std::to_string(before) + " -> " + std::to_string(now));
+		}
+	};
+	auto throughput = [&](const char* name, double before, double now) {
+		if (now < before * (1.0 - config.tolerance)) {
+			regressions.push_back(std::string(name) + ": " + std::to_string(before) + " -> " + std::to_string(now) + " /s");
+		}
+	};
+	latency("p50", baseline.p50, current.p50);
+	latency("p99", baseline.p99, current.p99);
+	latency("p99.9", baseline.p999, current.p999);
+	count("stalls", baseline.stalls, current.stalls);
+	throughput("inserts", baseline.insertsPerSecond, current.insertsPerSecond);
+	throughput("tokens", baseline.tokensPerSecond, current.tokensPerSecond);
+	return regressions;
+}
+
+inline void IngestBenchmark::report(std::ostream& out, const BenchmarkResult& result) {
+	out << "insert latency p50 " << result.p50 << " ns, p99 " << result.p99
+		<< " ns, p99.9 " << result.p999 << " ns, p99.999 " << result.p99999
+		<< " ns, max " << result.max << " ns, stalls " << result.stalls << '\n';
+	out << "inserts/s " << static_cast<std::uint64_t>(result.insertsPerSecond)
+		<< ", file ingest tokens/s " << static_cast<std::uint64_t>(result.tokensPerSecond) << '\n';
+}
+
+template<class T>
+inline T IngestBenchmark::median(std::vector<T> values) {
+	if (values.empty()) {
+		return T();
+	}
+	std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+	return values[values.size() / 2];
+}
+
+#endif
@@ -1,8 +1,92 @@
 #include <iostream>
 #include "user_interface.h" 
+#include "ingest_benchmark.h"
+#include <string>
 
+static const char* benchmark_usage =
+	"usage: main --benchmark [baseline] [--update] [--tokens N] [--vocabulary N]\n"
+	"       [--exponent X] [--tolerance X] [--runs N] [--stall-ns N]\n";
 
-int main() {
+// Runs the ingest benchmark and compares it with the baseline file, which is
+// written instead on the first run or with --update.
+static int runBenchmark(int argc, char* argv[]) {
+	std::string baselinePath = "ingest_baseline.txt";
+	bool update = false;
+	IngestBenchmark::Config config;
+	try {
+		for (int i = 2; i < argc; ++i) {
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (arg == "--update") {
+				update = true;
+			}
+			else if (arg == "--tokens" && hasValue) {
+				config.tokens = std::stoull(argv[++i]);
+			}
+			else if (arg == "--vocabulary" && hasValue) {
+				config.vocabulary = std::stoull(argv[++i]);
+			}
+			else if (arg == "--exponent" && hasValue) {
+				config.exponent = std::stod(argv[++i]);
+			}
+			else if (arg == "--tolerance" && hasValue) {
+				config.tolerance = std::stod(argv[++i]);
+			}
+			else if (arg == "--runs" && hasValue) {
+				config.runs = std::stoull(argv[++i]);
+			}
+			else if (arg == "--stall-ns" && hasValue) {
+				config.stallNanos = std::stoull(argv[++i]);
+			}
+			else if (arg.compare(0, 2, "--") != 0) {
+				baselinePath = arg;
+			}
+			else {
+				std::cout << benchmark_usage;
+				return 2;
+			}
+		}
+	}
+	catch (const std::exception&) {
+		std::cout << benchmark_usage;
+		return 2;
+	}
+
+	IngestBenchmark benchmark(config);
+	BenchmarkResult current;
+	try {
+		current = benchmark.run();
+	}
+	catch (const std::exception& error) {
+		std::cout << error.what() << '\n';
+		return 2;
+	}
+	IngestBenchmark::report(std::cout, current);
+
+	BenchmarkResult baseline;
+	if (update || !IngestBenchmark::loadBaseline(baselinePath, baseline)) {
+		if (!IngestBenchmark::saveBaseline(baselinePath, current)) {
+			std::cout << "cannot write baseline " << baselinePath << '\n';
+			return 2;
+		}
+		std::cout << "baseline saved to " << baselinePath << '\n';
+		return 0;
+	}
+	if (!IngestBenchmark::sameWorkload(baseline, current)) {
+		std::cout << "baseline " << baselinePath << " was recorded for another workload, rerun with --update\n";
+		return 2;
+	}
+	std::vector<std::string> regressions = benchmark.compare(baseline, current);
+	for (const auto& regression : regressions) {
+		std::cout << "regression " << regression << '\n';
+	}
+	return regressions.empty() ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+		return runBenchmark(argc, argv);
+	}
 	UserInterface a;
 	a.openFile("input.txt");
 	a.Menu();
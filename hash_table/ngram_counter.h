@@ -0,0 +1,243 @@
+#ifndef NGRAM_COUNTER_H
+#define NGRAM_COUNTER_H
+
+#include "dictionary_map.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// An n-gram stored as the interned ids of its tokens. The hash is carried in
+// the key because it is computed incrementally from the sliding window.
+template<size_t MaxN>
+struct NGramKey {
+	std::uint32_t ids[MaxN];
+	std::uint32_t n;
+	size_t hash;
+};
+
+template<size_t MaxN>
+struct NGramHash {
+	size_t operator()(const NGramKey<MaxN>& key) const noexcept {
+		return key.hash;
+	}
+};
+
+template<size_t MaxN>
+struct NGramEqual {
+	bool operator()(const NGramKey<MaxN>& left, const NGramKey<MaxN>& right) const noexcept {
+		return left.n == right.n && std::equal(left.ids, left.ids + left.n, right.ids);
+	}
+};
+
+// Counts every n-gram of orders minN..maxN over a stream of whitespace
+// separated tokens. Tokens are interned once; each order keeps a polynomial
+// hash of its window that is updated in O(1) per token, so no concatenated
+// strings are built and no window is rehashed. Words are only joined back
+// into strings when results are reported.
+template<size_t MaxN = 3>
+class NGramCounter {
+public:
+	using key_type = NGramKey<MaxN>;
+	using dictionary_type = DictionaryMap<key_type, NGramHash<MaxN>, NGramEqual<MaxN>>;
+	using value_type = std::pair<std::string, size_t>;
+
+	explicit NGramCounter(size_t minN = 2, size_t maxN = MaxN);
+
+	void insertToken(const std::string& token);
+	void insertLine(const std::string& line);
+	void insertText(std::istream& in);
+	void breakWindow();
+
+	std::size_t find(const std::vector<std::string>& words) const;
+	std::vector<value_type> topK(size_t n, size_t k) const;
+
+	size_t size(size_t n) const;
+	size_t vocabularySize() const noexcept;
+	void clear();
+
+private:
+	static const unsigned long long base = 0x100000001b3ULL;
+
+	size_t minN;
+	size_t maxN;
+	HashTable<std::string, std::uint32_t> ids;
+	std::vector<std::string> words;
+	std::vector<dictionary_type> counts;
+
+	std::uint32_t window[MaxN];
+	unsigned long long windowHash[MaxN];
+	unsigned long long rolling[MaxN + 1];
+	unsigned long long power[MaxN + 1];
+	size_t seen;
+	std::string token;
+
+	std::uint32_t intern(const std::string& word);
+	key_type makeKey(size_t n, unsigned long long hashCode) const;
+	static unsigned long long tokenHash(std::uint32_t id);
+	static size_t finishHash(unsigned long long hashCode, size_t n);
+};
+
+
+template<size_t MaxN>
+inline NGramCounter<MaxN>::NGramCounter(size_t minN, size_t maxN) :
+	minN(std::min<size_t>(std::max<size_t>(minN, 1), MaxN)),
+	maxN(std::min<size_t>(std::max(maxN, this->minN), MaxN)),
+	ids{},
+	words{},
+	counts(MaxN + 1),
+	seen(0)
+{
+	power[0] = 1;
+	for (size_t n = 1; n <= MaxN; ++n) {
+		power[n] = power[n - 1] * base;
+	}
+	breakWindow();
+}
+
+template<size_t MaxN>
+inline void NGramCounter<MaxN>::insertToken(const std::string& word) {
+	std::uint32_t id = intern(word);
+	unsigned long long hashCode = tokenHash(id);
+	for (size_t n = minN; n <= maxN; ++n) {
+		rolling[n] = rolling[n] * base + hashCode;
+		if (seen >= n) {
+			rolling[n] -= windowHash[(seen - n) % MaxN] * power[n];
+		}
+	}
+	window[seen % MaxN] = id;
+	windowHash[seen % MaxN] = hashCode;
+	++seen;
+	for (size_t n = minN; n <= maxN && n <= seen; ++n) {
+		counts[n].insert(makeKey(n, rolling[n]));
+	}
+}
+
+template<size_t MaxN>
+inline void NGramCounter<MaxN>::insertLine(const std::string& line) {
+	size_t pos = 0;
+	while (pos < line.size()) {
+		while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos]))) {
+			++pos;
+		}
+		size_t start = pos;
+		while (pos < line.size() && !std::isspace(static_cast<unsigned char>(line[pos]))) {
+			++pos;
+		}
+		if (pos > start) {
+			token.assign(line, start, pos - start);
+			insertToken(token);
+		}
+	}
+}
+
+template<size_t MaxN>
+inline void NGramCounter<MaxN>::insertText(std::istream& in) {
+	std::string line;
+	while (std::getline(in, line)) {
+		insertLine(line);
+	}
+}
+
+template<size_t MaxN>
+inline void NGramCounter<MaxN>::breakWindow() {
+	seen = 0;
+	std::fill(rolling, rolling + MaxN + 1, 0ULL);
+}
+
+template<size_t MaxN>
+inline std::size_t NGramCounter<MaxN>::find(const std::vector<std::string>& phrase) const {
+	size_t n = phrase.size();
+	if (n < minN || n > maxN) {
+		return 0;
+	}
+	key_type key{};
+	key.n = static_cast<std::uint32_t>(n);
+	unsigned long long hashCode = 0;
+	for (size_t i = 0; i < n; ++i) {
+		auto id = ids.find(phrase[i]);
+		if (!id.ptr_) {
+			return 0;
+		}
+		key.ids[i] = id->data.second;
+		hashCode = hashCode * base + tokenHash(key.ids[i]);
+	}
+	key.hash = finishHash(hashCode, n);
+	return counts[n].find(key);
+}
+
+template<size_t MaxN>
+inline std::vector<typename NGramCounter<MaxN>::value_type> NGramCounter<MaxN>::topK(size_t n, size_t k) const {
+	std::vector<value_type> result;
+	if (n < minN || n > maxN) {
+		return result;
+	}
+	for (const auto& entry : counts[n].topK(k)) {
+		std::string phrase;
+		for (size_t i = 0; i < entry.first.n; ++i) {
+			if (i != 0) {
+				phrase += ' ';
+			}
+			phrase += words[entry.first.ids[i]];
+		}
+		result.emplace_back(std::move(phrase), entry.second);
+	}
+	return result;
+}
+
+template<size_t MaxN>
+inline size_t NGramCounter<MaxN>::size(size_t n) const {
+	return n <= MaxN ? counts[n].size() : 0;
+}
+
+template<size_t MaxN>
+inline size_t NGramCounter<MaxN>::vocabularySize() const noexcept {
+	return words.size();
+}
+
+template<size_t MaxN>
+inline void NGramCounter<MaxN>::clear() {
+	ids.clear();
+	words.clear();
+	for (auto& dict : counts) {
+		dict.clear();
+	}
+	breakWindow();
+}
+
+template<size_t MaxN>
+inline std::uint32_t NGramCounter<MaxN>::intern(const std::string& word) {
+	auto id = ids.find(word);
+	if (id.ptr_) {
+		return id->data.second;
+	}
+	std::uint32_t next = static_cast<std::uint32_t>(words.size());
+	words.push_back(word);
+	ids.insert(std::pair<const std::string, std::uint32_t>(word, next));
+	return next;
+}
+
+template<size_t MaxN>
+inline NGramKey<MaxN> NGramCounter<MaxN>::makeKey(size_t n, unsigned long long hashCode) const {
+	key_type key{};
+	key.n = static_cast<std::uint32_t>(n);
+	for (size_t i = 0; i < n; ++i) {
+		key.ids[i] = window[(seen - n + i) % MaxN];
+	}
+	key.hash = finishHash(hashCode, n);
+	return key;
+}
+
+template<size_t MaxN>
+inline unsigned long long NGramCounter<MaxN>::tokenHash(std::uint32_t id) {
+	return IntegralHash<unsigned long long>{} (id) | 1;
+}
+
+template<size_t MaxN>
+inline size_t NGramCounter<MaxN>::finishHash(unsigned long long hashCode, size_t n) {
+	return IntegralHash<unsigned long long>{} (hashCode + n);
+}
+
+#endif
@@ -0,0 +1,375 @@
+#ifndef TIERED_DICTIONARY_H
+#define TIERED_DICTIONARY_H
+
+#include "dictionary_map.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Bit set with a fixed number of probes derived from one hash by double
+// hashing; used to skip spill runs that cannot hold a key.
+class BloomFilter {
+public:
+	explicit BloomFilter(size_t items = 0) :
+		bits((std::max<size_t>(items, 1) * bits_per_item + 63) / 64),
+		bitCount(bits.size() * 64)
+	{}
+
+	void add(size_t hashCode) {
+		size_t step = IntegralHash<size_t>{} (hashCode) | 1;
+		for (int i = 0; i < probes; ++i) {
+			size_t bit = (hashCode + i * step) % bitCount;
+			bits[bit / 64] |= 1ULL << (bit % 64);
+		}
+	}
+
+	bool mayContain(size_t hashCode) const {
+		size_t step = IntegralHash<size_t>{} (hashCode) | 1;
+		for (int i = 0; i < probes; ++i) {
+			size_t bit = (hashCode + i * step) % bitCount;
+			if (!(bits[bit / 64] & (1ULL << (bit % 64)))) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	static const size_t bits_per_item = 10;
+	static const int probes = 4;
+
+	std::vector<unsigned long long> bits;
+	size_t bitCount;
+};
+
+inline void writeRunKey(std::ostream& out, const std::string& key) {
+	std::uint32_t length = static_cast<std::uint32_t>(key.size());
+	out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+	out.write(key.data(), static_cast<std::streamsize>(key.size()));
+}
+
+inline bool readRunKey(std::istream& in, std::string& key) {
+	std::uint32_t length = 0;
+	if (!in.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+		return false;
+	}
+	key.resize(length);
+	return length == 0 || static_cast<bool>(in.read(&key[0], length));
+}
+
+template<class K>
+inline typename std::enable_if<std::is_integral<K>::value>::type writeRunKey(std::ostream& out, K key) {
+	out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+}
+
+template<class K>
+inline typename std::enable_if<std::is_integral<K>::value, bool>::type readRunKey(std::istream& in, K& key) {
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(&key), sizeof(key)));
+}
+
+// A DictionaryMap with a memory budget. Once the in-memory table grows past
+// the budget its entries are written to disk as a run sorted by Compare, with
+// a sparse index and a bloom filter kept in memory, and the table is emptied.
+// find() sums the count in memory and in every run; compact() and for_each()
+// k-way merge the runs, and more than max_runs runs are compacted on spill.
+// Compare must order keys consistently with KeyEqual.
+template<class Key,
+	class Hash = DefaultHash<Key>,
+	class KeyEqual = std::equal_to<Key>,
+	class Compare = std::less<Key>>
+class TieredDictionaryMap {
+public:
+	using key_type = Key;
+	using mapped_type = size_t;
+	using value_type = std::pair<Key, mapped_type>;
+	using dictionary_type = DictionaryMap<Key, Hash, KeyEqual>;
+
+	TieredDictionaryMap(const std::string& spillPrefix, size_t memoryBudget);
+	TieredDictionaryMap(const TieredDictionaryMap& copy) = delete;
+	TieredDictionaryMap& operator=(const TieredDictionaryMap& copy) = delete;
+	~TieredDictionaryMap();
+
+	void insert(const key_type& key);
+	void insert(const key_type& key, mapped_type count);
+	std::size_t find(const key_type& key);
+
+	void spill();
+	void compact();
+	template<class Function>
+	void for_each(Function f);
+
+	size_t runCount() const noexcept;
+	size_t memoryUsage() const noexcept;
+
+private:
+	struct SpillRun {
+		std::string path;
+		std::vector<std::pair<Key, std::streamoff>> index;
+		BloomFilter bloom;
+		std::ifstream in;
+	};
+
+	struct RunReader {
+		std::ifstream in;
+		Key key;
+		std::uint64_t count;
+	};
+
+	// Every index_stride-th record of a run is kept in its sparse index.
+	static const size_t index_stride = 64;
+	// Spilling past this many runs merges them into one.
+	static const size_t max_runs = 16;
+
+	std::string prefix;
+	size_t budget;
+	size_t nextRun;
+	size_t keyBytes;
+	dictionary_type memory;
+	std::vector<std::unique_ptr<SpillRun>> runs;
+
+	template<class Producer>
+	std::unique_ptr<SpillRun> writeRun(size_t records, Producer produce);
+	template<class Function>
+	void mergeRuns(Function emit);
+	std::size_t findInRun(SpillRun& run, const key_type& key);
+
+	static bool readRecord(std::istream& in, Key& key, std::uint64_t& count);
+	static bool equalKeys(const Key& left, const Key& right);
+};
+
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::TieredDictionaryMap(const std::string& spillPrefix, size_t memoryBudget) :
+	prefix(spillPrefix),
+	budget(memoryBudget),
+	nextRun(0),
+	keyBytes(0),
+	memory{}
+{}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::~TieredDictionaryMap() {
+	for (auto& run : runs) {
+		run->in.close();
+		std::remove(run->path.c_str());
+	}
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline void TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::insert(const key_type& key) {
+	insert(key, 1);
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline void TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::insert(const key_type& key, mapped_type count) {
+	size_t before = memory.size();
+	memory.insert(key, count);
+	if (memory.size() != before) {
+		keyBytes += keyHeapBytes(key);
+		if (memoryUsage() > budget) {
+			spill();
+		}
+	}
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline std::size_t TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::find(const key_type& key) {
+	std::size_t count = memory.find(key);
+	size_t hashCode = Hash{} (key);
+	for (auto& run : runs) {
+		if (run->bloom.mayContain(hashCode)) {
+			count += findInRun(*run, key);
+		}
+	}
+	return count;
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline void TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::spill() {
+	if (memory.empty()) {
+		return;
+	}
+	using entry_type = typename std::iterator_traits<typename dictionary_type::iterator>::value_type;
+	std::vector<const entry_type*> entries;
+	entries.reserve(memory.size());
+	for (auto iter = memory.begin(); iter.ptr_; ++iter) {
+		entries.push_back(&*iter);
+	}
+	std::sort(entries.begin(), entries.end(), [](const entry_type* left, const entry_type* right) {
+		return Compare{} (left->data.first, right->data.first);
+	});
+	// Reserved first so that a written run is never lost to a failed push_back.
+	runs.reserve(runs.size() + 1);
+	runs.push_back(writeRun(entries.size(), [&](auto emit) {
+		for (const entry_type* entry : entries) {
+			emit(entry->data.first, entry->data.second);
+		}
+	}));
+	// clear() would keep the grown bucket array counting against the budget.
+	memory = dictionary_type();
+	keyBytes = 0;
+	if (runs.size() > max_runs) {
+		compact();
+	}
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline void TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::compact() {
+	if (runs.size() < 2) {
+		return;
+	}
+	size_t records = 0;
+	for (auto& run : runs) {
+		records += run->index.size() * index_stride;
+	}
+	std::unique_ptr<SpillRun> merged = writeRun(records, [&](auto emit) {
+		mergeRuns(emit);
+	});
+	for (auto& run : runs) {
+		run->in.close();
+		std::remove(run->path.c_str());
+	}
+	runs.clear();
+	runs.push_back(std::move(merged));
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+template<class Function>
+inline void TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::for_each(Function f) {
+	spill();
+	mergeRuns([&f](const Key& key, std::uint64_t count) {
+		f(key, static_cast<mapped_type>(count));
+	});
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline size_t TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::runCount() const noexcept {
+	return runs.size();
+}
+
+// Bytes held by the in-memory tier, as DictionaryMap::memory_usage() counts
+// them, with the key bytes tracked on insert instead of walking the table.
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline size_t TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::memoryUsage() const noexcept {
+	using node_type = typename HashTable<Key, mapped_type, Hash, KeyEqual>::_Nodeptr;
+	return memory.size() * sizeof(ListNode<node_type>) + memory.bucket_count() * sizeof(HashBucket) + keyBytes;
+}
+
+// Calls produce(emit) and writes every (key, count) passed to emit, which
+// must come in Compare order, as a new run with its index and bloom filter.
+template<class Key, class Hash, class KeyEqual, class Compare>
+template<class Producer>
+inline std::unique_ptr<typename TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::SpillRun>
+TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::writeRun(size_t records, Producer produce) {
+	std::unique_ptr<SpillRun> run(new SpillRun{ prefix + "." + std::to_string(nextRun++) + ".run", {}, BloomFilter(records), std::ifstream() });
+	std::ofstream out(run->path, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		throw std::runtime_error("cannot open spill file " + run->path);
+	}
+	size_t written = 0;
+	try {
+		produce([&](const Key& key, std::uint64_t count) {
+			if (written++ % index_stride == 0) {
+				run->index.emplace_back(key, static_cast<std::streamoff>(out.tellp()));
+			}
+			run->bloom.add(Hash{} (key));
+			writeRunKey(out, key);
+			out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		});
+	}
+	catch (...) {
+		out.close();
+		std::remove(run->path.c_str());
+		throw;
+	}
+	out.close();
+	if (out.fail()) {
+		std::remove(run->path.c_str());
+		throw std::runtime_error("cannot write spill file " + run->path);
+	}
+	run->in.open(run->path, std::ios::binary);
+	return run;
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+template<class Function>
+inline void TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::mergeRuns(Function emit) {
+	std::vector<std::unique_ptr<RunReader>> readers;
+	for (auto& run : runs) {
+		std::unique_ptr<RunReader> reader(new RunReader{ std::ifstream(run->path, std::ios::binary), Key{}, 0 });
+		if (readRecord(reader->in, reader->key, reader->count)) {
+			readers.push_back(std::move(reader));
+		}
+	}
+	auto later = [&readers](size_t left, size_t right) {
+		return Compare{} (readers[right]->key, readers[left]->key);
+	};
+	std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+	for (size_t i = 0; i < readers.size(); ++i) {
+		heap.push(i);
+	}
+	while (!heap.empty()) {
+		size_t top = heap.top();
+		heap.pop();
+		Key key = readers[top]->key;
+		std::uint64_t count = readers[top]->count;
+		if (readRecord(readers[top]->in, readers[top]->key, readers[top]->count)) {
+			heap.push(top);
+		}
+		while (!heap.empty() && equalKeys(readers[heap.top()]->key, key)) {
+			size_t same = heap.top();
+			heap.pop();
+			count += readers[same]->count;
+			if (readRecord(readers[same]->in, readers[same]->key, readers[same]->count)) {
+				heap.push(same);
+			}
+		}
+		emit(key, count);
+	}
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline std::size_t TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::findInRun(SpillRun& run, const key_type& key) {
+	auto block = std::upper_bound(run.index.begin(), run.index.end(), key,
+		[](const Key& left, const std::pair<Key, std::streamoff>& right) {
+			return Compare{} (left, right.first);
+		});
+	if (block == run.index.begin()) {
+		return 0;
+	}
+	--block;
+	run.in.clear();
+	run.in.seekg(block->second);
+	Key current{};
+	std::uint64_t count = 0;
+	for (size_t i = 0; i < index_stride && readRecord(run.in, current, count); ++i) {
+		if (Compare{} (key, current)) {
+			break;
+		}
+		if (!Compare{} (current, key)) {
+			return static_cast<std::size_t>(count);
+		}
+	}
+	return 0;
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline bool TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::readRecord(std::istream& in, Key& key, std::uint64_t& count) {
+	return readRunKey(in, key) &&
+		static_cast<bool>(in.read(reinterpret_cast<char*>(&count), sizeof(count)));
+}
+
+template<class Key, class Hash, class KeyEqual, class Compare>
+inline bool TieredDictionaryMap<Key, Hash, KeyEqual, Compare>::equalKeys(const Key& left, const Key& right) {
+	return !Compare{} (left, right) && !Compare{} (right, left);
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define USER_INTERFACE_H
 
 #include "dictionary_map.h"
+#include "dictionary_export.h"
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -31,6 +32,8 @@ public:
 
 	void showDictionary(std::ostream& out);
 	void showTopTree(std::ostream& out);
+	bool exportDictionary(const std::string& filename, ExportFormat format);
+	void exportToFile();
 
 	size_t ditionarySize();
 	void clearDictionary();
@@ -119,6 +122,31 @@ inline void UserInterface::showTopTree(std::ostream& out) {
 	delete[] arr;
 }
 
+inline bool UserInterface::exportDictionary(const std::string& filename, ExportFormat format) {
+	std::ofstream out(filename, std::ios::binary);
+	if (!out.is_open()) {
+		return false;
+	}
+	DictionaryExporter<DictionaryMap<std::string>> exporter(format);
+	return exporter.write(dict, out);
+}
+
+inline void UserInterface::exportToFile() {
+	std::string filename;
+	std::string format;
+	std::cin >> filename >> format;
+	ExportFormat kind = ExportFormat::Tsv;
+	if (format == "csv") {
+		kind = ExportFormat::Csv;
+	}
+	else if (format == "json") {
+		kind = ExportFormat::JsonLines;
+	}
+	if (!exportDictionary(filename, kind)) {
+		std::cout << "Cannot write file!\n";
+	}
+}
+
 inline size_t UserInterface::ditionarySize() {
 	return dict.size();
 }
@@ -145,7 +173,8 @@ inline void UserInterface::showMenu() {
 	std::cout << "6) Show dictionary size\n";
 	std::cout << "7) Clear dictionary\n";
 	std::cout << "8) Show menu\n";
-	std::cout << "9) Stop\n\n";
+	std::cout << "9) Stop\n";
+	std::cout << "0) Export dictionary to a file: <name> <tsv|csv|json>\n\n";
 }
 
 inline void UserInterface::Menu() {
@@ -183,6 +212,9 @@ inline void UserInterface::Menu() {
 		else if (command == '9') {
 			break;
 		}
+		else if (command == '0') {
+			exportToFile();
+		}
 		else {
 			std::cout << "Wrond command!\n\n";
 			showMenu();
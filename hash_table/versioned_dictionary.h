@@ -0,0 +1,353 @@
+#ifndef VERSIONED_DICTIONARY_H
+#define VERSIONED_DICTIONARY_H
+
+#include "dictionary_map.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// One frozen generation of counts. Keys in erased were erased while this
+// layer was active, so older layers are not consulted for them.
+template<class Key, class Hash, class KeyEqual>
+struct DictionaryLayer {
+	DictionaryMap<Key, Hash, KeyEqual> counts;
+	HashTable<Key, bool, Hash, KeyEqual> erased;
+
+	size_t size() const noexcept {
+		return counts.size() + erased.size();
+	}
+};
+
+template<class Key, class Hash, class KeyEqual>
+using DictionaryLayers = std::vector<std::shared_ptr<const DictionaryLayer<Key, Hash, KeyEqual>>>;
+
+// A point-in-time view of a VersionedDictionaryMap. It only holds shared,
+// immutable layers, so it can be read from any thread while ingest goes on.
+template<class Key,
+	class Hash = DefaultHash<Key>,
+	class KeyEqual = std::equal_to<Key>>
+class DictionarySnapshot {
+public:
+	using key_type = Key;
+	using mapped_type = size_t;
+	using value_type = std::pair<Key, mapped_type>;
+	using dictionary_type = DictionaryMap<Key, Hash, KeyEqual>;
+
+	DictionarySnapshot() = default;
+	explicit DictionarySnapshot(std::shared_ptr<const DictionaryLayers<Key, Hash, KeyEqual>> layers);
+
+	std::size_t find(const key_type& key) const;
+	std::vector<value_type> topK(size_t k) const;
+	dictionary_type collapse() const;
+
+private:
+	std::shared_ptr<const DictionaryLayers<Key, Hash, KeyEqual>> layers;
+};
+
+// A DictionaryMap for one writer and any number of readers. Writes go to a
+// private active layer; snapshot() freezes it without copying any counts and
+// publishes the list of frozen layers. Once there are more than maxLayers,
+// snapshot() wakes a background thread that merges them outside the writer's
+// lock; past twice that, the thread calling snapshot() merges them itself, so
+// the layer count stays bounded even when the background thread falls behind.
+template<class Key,
+	class Hash = DefaultHash<Key>,
+	class KeyEqual = std::equal_to<Key>>
+class VersionedDictionaryMap {
+public:
+	using key_type = Key;
+	using mapped_type = size_t;
+	using value_type = std::pair<Key, mapped_type>;
+	using snapshot_type = DictionarySnapshot<Key, Hash, KeyEqual>;
+
+	explicit VersionedDictionaryMap(size_t maxLayers = 8);
+	VersionedDictionaryMap(const VersionedDictionaryMap& copy) = delete;
+	VersionedDictionaryMap& operator=(const VersionedDictionaryMap& copy) = delete;
+	~VersionedDictionaryMap();
+
+	void insert(const key_type& key);
+	void insert(const key_type& key, mapped_type count);
+	bool erase(const key_type& key);
+	std::size_t find(const key_type& key);
+	void clear();
+
+	snapshot_type snapshot();
+	void compact();
+	size_t layerCount();
+
+private:
+	using layer_type = DictionaryLayer<Key, Hash, KeyEqual>;
+	using layers_type = DictionaryLayers<Key, Hash, KeyEqual>;
+
+	size_t maxLayers;
+	std::unique_ptr<layer_type> active;
+	std::shared_ptr<const layers_type> frozen;
+	std::mutex mutex;
+	std::mutex compactMutex;
+	std::mutex workerMutex;
+	std::condition_variable workerWake;
+	std::thread worker;
+	bool compactRequested;
+	bool stopping;
+
+	void requestCompact();
+	void compactLoop();
+	static std::size_t findIn(const layers_type& layers, const layer_type* top, const key_type& key);
+	static void applyLayer(layer_type& base, const layer_type& top);
+};
+
+
+template<class Key, class Hash, class KeyEqual>
+inline DictionarySnapshot<Key, Hash, KeyEqual>::DictionarySnapshot(std::shared_ptr<const DictionaryLayers<Key, Hash, KeyEqual>> layers) :
+	layers(std::move(layers))
+{}
+
+template<class Key, class Hash, class KeyEqual>
+inline std::size_t DictionarySnapshot<Key, Hash, KeyEqual>::find(const key_type& key) const {
+	std::size_t count = 0;
+	if (!layers) {
+		return count;
+	}
+	for (auto layer = layers->rbegin(); layer != layers->rend(); ++layer) {
+		count += (*layer)->counts.find(key);
+		if ((*layer)->erased.find(key).ptr_) {
+			break;
+		}
+	}
+	return count;
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline std::vector<typename DictionarySnapshot<Key, Hash, KeyEqual>::value_type> DictionarySnapshot<Key, Hash, KeyEqual>::topK(size_t k) const {
+	if (layers && layers->size() == 1) {
+		return layers->front()->counts.topK(k);
+	}
+	return collapse().topK(k);
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline DictionaryMap<Key, Hash, KeyEqual> DictionarySnapshot<Key, Hash, KeyEqual>::collapse() const {
+	if (!layers || layers->empty()) {
+		return dictionary_type();
+	}
+	dictionary_type result(layers->front()->counts);
+	for (size_t i = 1; i < layers->size(); ++i) {
+		const DictionaryLayer<Key, Hash, KeyEqual>& layer = *(*layers)[i];
+		for (auto iter = layer.erased.cbegin(); iter.ptr_; ++iter) {
+			result.erase(iter->data.first);
+		}
+		result.merge(layer.counts);
+	}
+	return result;
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline VersionedDictionaryMap<Key, Hash, KeyEqual>::VersionedDictionaryMap(size_t maxLayers) :
+	maxLayers(maxLayers < 1 ? 1 : maxLayers),
+	active(new layer_type),
+	frozen(std::make_shared<layers_type>()),
+	compactRequested(false),
+	stopping(false)
+{}
+
+template<class Key, class Hash, class KeyEqual>
+inline VersionedDictionaryMap<Key, Hash, KeyEqual>::~VersionedDictionaryMap() {
+	{
+		std::lock_guard<std::mutex> lock(workerMutex);
+		stopping = true;
+	}
+	workerWake.notify_one();
+	if (worker.joinable()) {
+		worker.join();
+	}
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void VersionedDictionaryMap<Key, Hash, KeyEqual>::insert(const key_type& key) {
+	std::lock_guard<std::mutex> lock(mutex);
+	active->counts.insert(key);
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void VersionedDictionaryMap<Key, Hash, KeyEqual>::insert(const key_type& key, mapped_type count) {
+	std::lock_guard<std::mutex> lock(mutex);
+	active->counts.insert(key, count);
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline bool VersionedDictionaryMap<Key, Hash, KeyEqual>::erase(const key_type& key) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (findIn(*frozen, active.get(), key) == 0) {
+		return false;
+	}
+	if (!frozen->empty() && !active->erased.insert(std::pair<const Key, bool>(key, true)).first.ptr_) {
+		throw std::bad_alloc();
+	}
+	active->counts.erase(key);
+	return true;
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline std::size_t VersionedDictionaryMap<Key, Hash, KeyEqual>::find(const key_type& key) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return findIn(*frozen, active.get(), key);
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void VersionedDictionaryMap<Key, Hash, KeyEqual>::clear() {
+	std::unique_ptr<layer_type> fresh(new layer_type);
+	std::shared_ptr<const layers_type> empty = std::make_shared<layers_type>();
+	std::lock_guard<std::mutex> lock(mutex);
+	active.swap(fresh);
+	frozen.swap(empty);
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline DictionarySnapshot<Key, Hash, KeyEqual> VersionedDictionaryMap<Key, Hash, KeyEqual>::snapshot() {
+	std::unique_ptr<layer_type> fresh(new layer_type);
+	std::shared_ptr<const layers_type> published;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (active->size() != 0) {
+			std::shared_ptr<layers_type> next = std::make_shared<layers_type>(*frozen);
+			next->push_back(std::shared_ptr<const layer_type>(active.release()));
+			active.swap(fresh);
+			frozen = next;
+		}
+		published = frozen;
+	}
+	if (published->size() > 2 * maxLayers) {
+		try {
+			compact();
+		}
+		catch (const std::bad_alloc&) {
+			// The layers are intact; the next snapshot tries again.
+		}
+	}
+	else if (published->size() > maxLayers) {
+		requestCompact();
+	}
+	return snapshot_type(published);
+}
+
+// Starts the background compactor on first use. If the thread cannot be
+// started, snapshot() falls back to compacting once past twice the bound.
+template<class Key, class Hash, class KeyEqual>
+inline void VersionedDictionaryMap<Key, Hash, KeyEqual>::requestCompact() {
+	{
+		std::lock_guard<std::mutex> lock(workerMutex);
+		compactRequested = true;
+		if (!worker.joinable()) {
+			try {
+				worker = std::thread(&VersionedDictionaryMap::compactLoop, this);
+			}
+			catch (const std::system_error&) {
+				return;
+			}
+		}
+	}
+	workerWake.notify_one();
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void VersionedDictionaryMap<Key, Hash, KeyEqual>::compactLoop() {
+	std::unique_lock<std::mutex> lock(workerMutex);
+	while (true) {
+		workerWake.wait(lock, [this] { return compactRequested || stopping; });
+		if (stopping) {
+			return;
+		}
+		compactRequested = false;
+		lock.unlock();
+		try {
+			compact();
+		}
+		catch (const std::bad_alloc&) {
+			// Retried on the next request.
+		}
+		lock.lock();
+	}
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline size_t VersionedDictionaryMap<Key, Hash, KeyEqual>::layerCount() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return frozen->size();
+}
+
+// Merges the newest frozen layers while they are at least half the size of
+// the layer below them, or while there are more than maxLayers, so the layer
+// count stays logarithmic. The merge reads immutable layers only; the lock is
+// held just to splice the result back in. New layers are only appended and
+// only the compactor removes any, so the merged range keeps its position
+// unless clear() ran meanwhile, in which case the result is dropped. If the
+// merge runs out of memory, bad_alloc is thrown and the layers are kept.
+template<class Key, class Hash, class KeyEqual>
+inline void VersionedDictionaryMap<Key, Hash, KeyEqual>::compact() {
+	std::lock_guard<std::mutex> compactLock(compactMutex);
+	std::shared_ptr<const layers_type> current;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		current = frozen;
+	}
+	size_t count = current->size();
+	if (count < 2) {
+		return;
+	}
+	size_t first = count - 1;
+	size_t merged = (*current)[first]->size();
+	while (first > 0 && (merged * 2 >= (*current)[first - 1]->size() || first >= maxLayers)) {
+		--first;
+		merged += (*current)[first]->size();
+	}
+	if (first == count - 1) {
+		return;
+	}
+	std::shared_ptr<layer_type> result = std::make_shared<layer_type>(*(*current)[first]);
+	for (size_t i = first + 1; i < count; ++i) {
+		applyLayer(*result, *(*current)[i]);
+	}
+	if (first == 0) {
+		result->erased.clear();
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (frozen->size() < count || (*frozen)[first] != (*current)[first] || (*frozen)[count - 1] != (*current)[count - 1]) {
+		return;
+	}
+	std::shared_ptr<layers_type> next = std::make_shared<layers_type>(frozen->begin(), frozen->begin() + first);
+	next->push_back(result);
+	next->insert(next->end(), frozen->begin() + count, frozen->end());
+	frozen = next;
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline std::size_t VersionedDictionaryMap<Key, Hash, KeyEqual>::findIn(const layers_type& layers, const layer_type* top, const key_type& key) {
+	std::size_t count = top->counts.find(key);
+	if (top->erased.find(key).ptr_) {
+		return count;
+	}
+	for (auto layer = layers.rbegin(); layer != layers.rend(); ++layer) {
+		count += (*layer)->counts.find(key);
+		if ((*layer)->erased.find(key).ptr_) {
+			break;
+		}
+	}
+	return count;
+}
+
+template<class Key, class Hash, class KeyEqual>
+inline void VersionedDictionaryMap<Key, Hash, KeyEqual>::applyLayer(layer_type& base, const layer_type& top) {
+	for (auto iter = top.erased.cbegin(); iter.ptr_; ++iter) {
+		base.counts.erase(iter->data.first);
+		if (!base.erased.insert(iter->data).first.ptr_) {
+			throw std::bad_alloc();
+		}
+	}
+	base.counts.merge(top.counts);
+}
+
+#endif